@@ -20,6 +20,16 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  *****************************************************************************/
 
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "common.h"
 #include "strtools.h"
 
@@ -32,43 +42,62 @@ bool gopt_check_output = false;
 //! global command line parameter: named RANGEs to process
 std::vector<std::string> gopt_ranges;
 
-//! global SQL datbase connection handle
-SqlDatabase* g_db = NULL;
+//! prefetch read-only directive queries in batches between barriers
+bool gopt_prefetch = false;
+
+//! create indexes for read-only directive queries (SQLite only)
+bool gopt_index_advisor = false;
+
+//! number of additional read connections running queries in parallel
+unsigned int gopt_pool_size = 0;
+
+//! skip directives unchanged since the last run, using state files
+bool gopt_incremental = false;
+
+//! SQL database connection handle of the current thread's session
+thread_local SqlDatabase* g_db = NULL;
+
+//! pool of read connections of the current session, NULL unless enabled
+thread_local SqlPool* g_pool = NULL;
+
+//! log stream of the current thread's session, NULL writes to std::cerr
+thread_local std::ostream* g_log = NULL;
 
 #include "pgsql.h"
 #include "mysql.h"
 #include "sqlite.h"
+#include "sqlpool.h"
 
-//! initialize global SQL database connection
-bool g_db_connect(const std::string& db_conninfo)
+//! open a new SQL database connection, returns NULL on failure
+SqlDatabase* sql_connect(const std::string& db_conninfo)
 {
-    g_db_free();
+    SqlDatabase* db;
 
     if (db_conninfo.size() == 0)
     {
 #if HAVE_POSTGRESQL
         //! first try to connect to a PostgreSQL database
 
-        g_db = new PgSqlDatabase;
-        if (g_db->initialize(""))
-            return true;
-        delete g_db;
+        db = new PgSqlDatabase;
+        if (db->initialize(""))
+            return db;
+        delete db;
 #endif
 #if HAVE_MYSQL
         //! then try to connect to a MySQL database called "test"
 
-        g_db = new MySqlDatabase();
-        if (g_db->initialize("test"))
-            return true;
-        delete g_db;
+        db = new MySqlDatabase();
+        if (db->initialize("test"))
+            return db;
+        delete db;
 #endif
 #if HAVE_SQLITE3
         //! then try to connect to an in-memory SQLite database
 
-        g_db = new SQLiteDatabase();
-        if (g_db->initialize(":memory:"))
-            return true;
-        delete g_db;
+        db = new SQLiteDatabase();
+        if (db->initialize(":memory:"))
+            return db;
+        delete db;
 #endif
     }
     else
@@ -91,10 +120,10 @@ bool g_db_connect(const std::string& db_conninfo)
         else if (sqlname == "postgresql" || sqlname == "postgres" ||
                  sqlname == "pgsql" || sqlname == "pg")
         {
-            g_db = new PgSqlDatabase;
-            if (g_db->initialize(dbname))
-                return true;
-            delete g_db;
+            db = new PgSqlDatabase;
+            if (db->initialize(dbname))
+                return db;
+            delete db;
         }
 #endif
 #if HAVE_MYSQL
@@ -102,10 +131,10 @@ bool g_db_connect(const std::string& db_conninfo)
         {
             if (dbname.size() == 0) dbname = "test";
 
-            g_db = new MySqlDatabase;
-            if (g_db->initialize(dbname))
-                return true;
-            delete g_db;
+            db = new MySqlDatabase;
+            if (db->initialize(dbname))
+                return db;
+            delete db;
         }
 #endif
 #if HAVE_SQLITE3
@@ -113,10 +142,10 @@ bool g_db_connect(const std::string& db_conninfo)
         {
             if (dbname.size() == 0) dbname = ":memory:";
 
-            g_db = new SQLiteDatabase;
-            if (g_db->initialize(dbname))
-                return true;
-            delete g_db;
+            db = new SQLiteDatabase;
+            if (db->initialize(dbname))
+                return db;
+            delete db;
         }
 #endif
         else
@@ -126,14 +155,153 @@ bool g_db_connect(const std::string& db_conninfo)
         }
     }
 
-    return false;
+    return NULL;
+}
+
+//! test whether a connection string refers to a private in-memory SQLite
+//! database, which other connections cannot see.
+bool sql_is_private_memory(const std::string& db_conninfo)
+{
+    if (g_db->type() != SqlDatabase::DB_SQLITE) return false;
+
+    std::string path;
+    std::string::size_type colonpos = db_conninfo.find(':');
+    if (colonpos != std::string::npos)
+        path = db_conninfo.substr(colonpos + 1);
+
+    std::string options;
+    std::string::size_type qpos = path.find('?');
+    if (qpos != std::string::npos) {
+        options = path.substr(qpos);
+        path = path.substr(0, qpos);
+    }
+
+    return (path.empty() || path == ":memory:") &&
+           options.find("cache=shared") == std::string::npos;
+}
+
+//! initialize SQL database connection of the current session
+bool g_db_connect(const std::string& db_conninfo)
+{
+    g_db_free();
+
+    g_db = sql_connect(db_conninfo);
+    if (!g_db) return false;
+
+    if (gopt_pool_size > 0)
+    {
+        if (sql_is_private_memory(db_conninfo)) {
+            OUT("Connection pool disabled: a private in-memory SQLite "
+                "database is not visible to other connections.");
+        }
+        else {
+            g_pool = new SqlPool;
+            if (!g_pool->initialize(db_conninfo, gopt_pool_size)) {
+                delete g_pool;
+                g_pool = NULL;
+            }
+        }
+    }
+
+    return true;
 }
 
-//! free global SQL database connection
+//! free SQL database connection of the current session
 void g_db_free()
 {
+    if (g_pool) {
+        delete g_pool;
+        g_pool = NULL;
+    }
     if (g_db) {
         delete g_db;
         g_db = NULL;
     }
 }
+
+//! return the file creation mask, which can only be read by setting it
+static mode_t read_umask()
+{
+    mode_t mask = umask(0);
+    umask(mask);
+    return mask;
+}
+
+//! file creation mask of the process, read before any sessions are started
+static const mode_t g_umask = read_umask();
+
+//! write data to a file unless it already contains exactly this data, returns
+//! false if it was unchanged. The new contents are written to a unique
+//! temporary file next to it and flushed to disk, which then atomically
+//! replaces the file.
+bool write_file_if_changed(const std::string& filename, const std::string& data)
+{
+    // replace the target of a symbolic link, not the link itself
+    std::string path = filename;
+    if (char* real = realpath(filename.c_str(), NULL)) {
+        path = real;
+        free(real);
+    }
+
+    struct stat st;
+    bool exists = (stat(path.c_str(), &st) == 0);
+
+    if (exists && (size_t)st.st_size == data.size())
+    {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (in.good() && read_stream(in) == data)
+            return false;
+    }
+
+    std::vector<char> tmpl(path.begin(), path.end());
+    const char suffix[] = ".XXXXXX";
+    tmpl.insert(tmpl.end(), suffix, suffix + sizeof(suffix));
+
+    int fd = mkstemp(tmpl.data());
+    if (fd < 0)
+        OUT_THROW("Error creating temporary file for " << path << ": " << strerror(errno));
+
+    std::string tmpname = tmpl.data();
+
+    const char* ptr = data.data();
+    size_t left = data.size();
+    bool ok = true;
+
+    while (ok && left > 0)
+    {
+        ssize_t wb = write(fd, ptr, left);
+        if (wb < 0) {
+            ok = (errno == EINTR);
+            continue;
+        }
+        ptr += wb;
+        left -= wb;
+    }
+
+    // keep permissions of the replaced file, mkstemp() creates it with 0600
+    if (ok)
+        ok = (fchmod(fd, exists ? (st.st_mode & 07777) : (0666 & ~g_umask)) == 0);
+
+    // the data must be on disk before the name refers to it
+    if (ok)
+        ok = (fsync(fd) == 0);
+
+    int err = errno;
+    if (close(fd) != 0 && ok) {
+        ok = false;
+        err = errno;
+    }
+
+    if (!ok) {
+        unlink(tmpname.c_str());
+        OUT_THROW("Error writing " << tmpname << ": " << strerror(err));
+    }
+
+    if (rename(tmpname.c_str(), path.c_str()) != 0) {
+        int err = errno;
+        remove(tmpname.c_str());
+        OUT_THROW("Error replacing " << path << ": " << strerror(err));
+    }
+
+    return true;
+}
@@ -40,21 +40,51 @@ extern bool gopt_check_output;
 //! global command line parameter: named RANGEs to process
 extern std::vector<std::string> gopt_ranges;
 
-//! global SQL database connection handle
-extern SqlDatabase* g_db;
+//! prefetch read-only directive queries in batches between barriers
+extern bool gopt_prefetch;
 
-//! initialize global SQL database connection
+//! create indexes for read-only directive queries (SQLite only)
+extern bool gopt_index_advisor;
+
+//! number of additional read connections running queries in parallel
+extern unsigned int gopt_pool_size;
+
+//! skip directives unchanged since the last run, using state files
+extern bool gopt_incremental;
+
+//! SQL database connection handle of the current thread's session
+extern thread_local SqlDatabase* g_db;
+
+//! pool of read connections of the current session, NULL unless enabled
+extern thread_local class SqlPool* g_pool;
+
+//! log stream of the current thread's session, NULL writes to std::cerr
+extern thread_local std::ostream* g_log;
+
+//! open a new SQL database connection, returns NULL on failure
+extern SqlDatabase* sql_connect(const std::string& db_conninfo);
+
+//! test whether a connection string refers to a private in-memory SQLite
+//! database, which other connections cannot see.
+extern bool sql_is_private_memory(const std::string& db_conninfo);
+
+//! initialize SQL database connection of the current session
 extern bool g_db_connect(const std::string& db_conninfo);
 
-//! free global SQL database connection
+//! free SQL database connection of the current session
 extern void g_db_free();
 
+//! write data to a file unless it already contains exactly this data, returns
+//! false if it was unchanged.
+extern bool write_file_if_changed(const std::string& filename,
+                                  const std::string& data);
+
 #ifdef OUT
 #undef OUT
 #endif
 
 //! conditional debug output
-#define OUTC(dbg,X)   do { if (dbg) { std::cerr << X; } } while(0)
+#define OUTC(dbg,X)   do { if (dbg) { (g_log ? *g_log : std::cerr) << X; } } while(0)
 
 //! write output to std::cerr without newline
 #define OUTX(X)       OUTC(true, X)
@@ -0,0 +1,240 @@
+/******************************************************************************
+ * src/docstate.cpp
+ *
+ * Sidecar state file of a processed document, which allows skipping
+ * directives whose command, data and output did not change since the last run.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#include "docstate.h"
+#include "common.h"
+#include "strtools.h"
+#include "simpleglob.h"
+#include "plan.h"
+
+#include <boost/regex.hpp>
+
+//! first line of state files
+static const char* state_magic = "# sqlplot-tools state 1";
+
+//! FNV-1a hash of data, continuing from h
+static inline uint64_t
+fnv1a(const std::string& data, uint64_t h = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < data.size(); ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+//! return size and modification time of a file, or "-" if it is missing
+static inline std::string
+file_stamp(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return "-";
+
+    std::ostringstream os;
+    os << st.st_size << ':' << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec;
+    return os.str();
+}
+
+//! return stamps of the files imported by an IMPORT-DATA directive, or an
+//! empty string if they cannot be determined.
+static inline std::string
+import_stamp(const std::string& cmd)
+{
+    std::vector<std::string> args = split_ws(cmd);
+    std::vector<const char*> files;
+    bool table = false;
+
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        // importing into another database is not tracked
+        if (args[i] == "-D") return std::string();
+        if (args[i][0] == '-') continue;
+
+        if (!table) table = true;
+        else files.push_back(args[i].c_str());
+    }
+
+    // data from stdin is not tracked
+    if (files.empty()) return std::string();
+
+    CSimpleGlob glob(SG_GLOB_NODOT | SG_GLOB_NOCHECK);
+    if (SG_SUCCESS != glob.Add(files.size(), files.data()))
+        return std::string();
+
+    std::string stamp;
+    for (int fi = 0; fi < glob.FileCount(); ++fi)
+        stamp += std::string(glob.File(fi)) + ' ' + file_stamp(glob.File(fi)) + '\n';
+
+    return stamp;
+}
+
+//! test whether SQL only consists of statements creating or writing tables,
+//! views and indexes of the main or temporary database, which do not read
+//! virtual tables or table-valued functions. Their effect depends only on the
+//! data version, others like ATTACH or resultfiles() may read files which are
+//! not tracked.
+static inline bool
+plain_sql(const std::string& sql)
+{
+    static const boost::regex re_plain(
+        "\\A\\s*(?:CREATE\\s+(?:TEMP\\s+|TEMPORARY\\s+)?(?:TABLE|VIEW)|"
+        "CREATE\\s+(?:UNIQUE\\s+)?INDEX|DROP\\s+(?:TABLE|VIEW|INDEX)|"
+        "INSERT(?:\\s+OR\\s+\\w+)?\\s+INTO|REPLACE\\s+INTO|"
+        "UPDATE(?:\\s+OR\\s+\\w+)?|DELETE\\s+FROM)\\s+"
+        "(?:IF\\s+(?:NOT\\s+)?EXISTS\\s+)?([^\\s(]+)",
+        boost::regex::icase);
+
+    // quoted semicolons split statements conservatively
+    std::vector<std::string> stmts = split(sql, ';');
+    bool any = false;
+
+    for (size_t i = 0; i < stmts.size(); ++i)
+    {
+        if (trim(stmts[i], " \t\r\n").empty()) continue;
+
+        boost::smatch rm;
+        if (!boost::regex_search(stmts[i], rm, re_plain))
+            return false;
+
+        // objects of attached databases are not tracked
+        std::vector<std::string> parts = split(rm.str(1), '.');
+        if (parts.size() > 1 && str_tolower(parts[0]) != "main" &&
+            str_tolower(parts[0]) != "temp")
+            return false;
+
+        any = true;
+    }
+
+    // e.g. CREATE TABLE t AS SELECT * FROM resultfiles('*.txt')
+    return any && !mentions_any(sql, g_db->virtual_objects());
+}
+
+//! load state file of the document, if it exists
+DocumentState::DocumentState(const std::string& docname)
+    : m_filename(docname + ".sp-state"),
+      m_data(0), m_known(false)
+{
+    std::ifstream in(m_filename.c_str());
+    std::string line;
+
+    if (!std::getline(in, line) || line != state_magic) return;
+    if (!std::getline(in, m_old_version)) return;
+
+    while (std::getline(in, line))
+    {
+        Record r;
+        std::istringstream is(line);
+        if (!(is >> std::hex >> r.command >> r.data >> r.output)) {
+            m_old.clear();
+            return;
+        }
+        m_old.push_back(r);
+    }
+}
+
+//! start with the database version, empty if it cannot be determined
+void DocumentState::begin(const std::string& db_version)
+{
+    // records are valid if the database was not modified since the last run
+    m_known = !db_version.empty() && db_version == m_old_version;
+    m_data = fnv1a(std::string());
+}
+
+//! add a SQL, IMPORT-DATA or CONNECT directive to the data version
+void DocumentState::barrier(const std::string& first_word,
+                            const std::string& cmd)
+{
+    m_data = fnv1a(cmd + '\n', m_data);
+
+    if (first_word == "IMPORT-DATA")
+    {
+        std::string stamp = import_stamp(cmd);
+        if (stamp.empty()) m_known = false;
+        m_data = fnv1a(stamp, m_data);
+    }
+    else if (first_word == "SQL")
+    {
+        if (!plain_sql(cmd.substr(first_word.size())))
+            m_known = false;
+    }
+    else if (first_word == "CONNECT")
+    {
+        // the version of the other database is not known before connecting
+        m_known = false;
+    }
+}
+
+//! record the next read-only directive, returns true if its command, data and
+//! current output lines are unchanged since the last run.
+bool DocumentState::unchanged(const std::string& cmd,
+                              const std::string& output)
+{
+    Record r;
+    r.command = fnv1a(cmd);
+    r.data = m_data;
+    r.output = 0;
+
+    size_t k = m_new.size();
+    m_new.push_back(r);
+
+    return m_known && k < m_old.size() &&
+           m_old[k].command == r.command && m_old[k].data == r.data &&
+           m_old[k].output == fnv1a(output);
+}
+
+//! write state file with the final output lines of all recorded directives,
+//! or remove it if they do not match.
+void DocumentState::save(const std::vector<std::string>& outputs,
+                         const std::string& db_version)
+{
+    if (outputs.size() != m_new.size() || db_version.empty()) {
+        remove(m_filename.c_str());
+        return;
+    }
+
+    std::ostringstream out;
+    out << state_magic << '\n' << db_version << '\n' << std::hex;
+
+    for (size_t k = 0; k < m_new.size(); ++k)
+    {
+        out << m_new[k].command << ' ' << m_new[k].data << ' '
+            << fnv1a(outputs[k]) << '\n';
+    }
+
+    // replace atomically, a partial state file could match a prefix of the
+    // directives whose output was never written
+    try {
+        write_file_if_changed(m_filename, out.str());
+    }
+    catch (std::runtime_error& e) {
+        OUT(e.what());
+        remove(m_filename.c_str());
+    }
+}
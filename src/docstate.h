@@ -0,0 +1,87 @@
+/******************************************************************************
+ * src/docstate.h
+ *
+ * Sidecar state file of a processed document, which allows skipping
+ * directives whose command, data and output did not change since the last run.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DOCSTATE_HEADER
+#define DOCSTATE_HEADER
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! State of the read-only directives of a document, kept in a file next to
+//! it. Each directive is recorded with hashes of its command, of the data
+//! version it was run on and of its output lines. The data version chains
+//! all SQL, IMPORT-DATA and CONNECT directives before it, including the files
+//! they import, and is only valid if the database version did not change
+//! since the end of the last run. SQL which may read untracked files, like
+//! ATTACH, virtual tables or table-valued functions, and CONNECT make it
+//! unknown.
+class DocumentState
+{
+public:
+    //! hashes of one read-only directive
+    struct Record
+    {
+        uint64_t command, data, output;
+    };
+
+protected:
+    //! state file name
+    std::string m_filename;
+
+    //! database version at the end of the last run
+    std::string m_old_version;
+
+    //! records of the last run
+    std::vector<Record> m_old;
+
+    //! records of this run, output hashes are filled in by save()
+    std::vector<Record> m_new;
+
+    //! current data version
+    uint64_t m_data;
+
+    //! false if the data version cannot be determined
+    bool m_known;
+
+public:
+    //! load state file of the document, if it exists
+    explicit DocumentState(const std::string& docname);
+
+    //! start with the database version, empty if it cannot be determined
+    void begin(const std::string& db_version);
+
+    //! add a SQL, IMPORT-DATA or CONNECT directive to the data version
+    void barrier(const std::string& first_word, const std::string& cmd);
+
+    //! record the next read-only directive, returns true if its command, data
+    //! and current output lines are unchanged since the last run.
+    bool unchanged(const std::string& cmd, const std::string& output);
+
+    //! write state file with the final output lines of all recorded
+    //! directives, or remove it if they do not match.
+    void save(const std::vector<std::string>& outputs,
+              const std::string& db_version);
+};
+
+#endif // DOCSTATE_HEADER
@@ -0,0 +1,158 @@
+/******************************************************************************
+ * src/downsample.cpp
+ *
+ * Largest-Triangle-Three-Buckets downsampling of plot series.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+
+#include "downsample.h"
+#include "common.h"
+#include "strtools.h"
+
+//! Select at most maxpoints indexes of the series (x,y) which preserve its
+//! visual shape using Largest-Triangle-Three-Buckets.
+std::vector<size_t> lttb_select(const std::vector<double>& x,
+                                const std::vector<double>& y,
+                                size_t maxpoints)
+{
+    size_t n = x.size();
+    std::vector<size_t> sel;
+
+    if (maxpoints >= n || maxpoints < 3)
+    {
+        for (size_t i = 0; i < n; ++i) sel.push_back(i);
+        return sel;
+    }
+
+    // the inner points are split into maxpoints-2 buckets, each contributes
+    // the point forming the largest triangle with the previously selected
+    // point and the average of the next bucket.
+    double every = (double)(n - 2) / (maxpoints - 2);
+    size_t a = 0;
+
+    sel.push_back(0);
+
+    for (size_t b = 0; b < maxpoints - 2; ++b)
+    {
+        // average point of next bucket, or the last point
+        size_t avg_begin = (size_t)((b + 1) * every) + 1;
+        size_t avg_end = std::min((size_t)((b + 2) * every) + 1, n);
+
+        double avg_x = 0, avg_y = 0;
+        for (size_t i = avg_begin; i < avg_end; ++i)
+            avg_x += x[i], avg_y += y[i];
+        avg_x /= avg_end - avg_begin;
+        avg_y /= avg_end - avg_begin;
+
+        // point of current bucket with largest triangle area
+        size_t begin = (size_t)(b * every) + 1;
+        size_t end = (size_t)((b + 1) * every) + 1;
+
+        double max_area = -1;
+        size_t max_i = begin;
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            double area = std::fabs(
+                (x[a] - avg_x) * (y[i] - y[a]) - (x[a] - x[i]) * (avg_y - y[a]));
+            if (area > max_area) {
+                max_area = area;
+                max_i = i;
+            }
+        }
+
+        sel.push_back(max_i);
+        a = max_i;
+    }
+
+    sel.push_back(n - 1);
+    return sel;
+}
+
+//! Parse the value of a "maxpoints=N" modifier.
+size_t parse_maxpoints(const std::string& modifier)
+{
+    size_t maxpoints;
+    if (!is_prefix(modifier, "maxpoints=") ||
+        !from_str(modifier.substr(10), maxpoints) || maxpoints < 3)
+        OUT_THROW("Invalid modifier '" << modifier << "': maxpoints must be "
+                  "a number of at least 3.");
+
+    return maxpoints;
+}
+
+//! append a formatted point with coordinates x and y
+void PlotSeries::add(const std::string& x, const std::string& y,
+                     const std::string& point)
+{
+    if (!m_maxpoints) {
+        m_text += point;
+        return;
+    }
+
+    m_points.push_back(point);
+
+    double dx, dy;
+    if (m_numeric && from_str(x, dx) && from_str(y, dy)) {
+        m_x.push_back(dx);
+        m_y.push_back(dy);
+    }
+    else if (m_numeric) {
+        OUT("Warning: series has non-numeric coordinate (" << x << ',' << y
+            << "), maxpoints is ignored.");
+        m_numeric = false;
+    }
+}
+
+//! return the concatenated, possibly downsampled points and clear series
+std::string PlotSeries::str()
+{
+    if (!m_maxpoints) {
+        std::string out;
+        out.swap(m_text);
+        return out;
+    }
+
+    std::string out;
+
+    if (m_numeric && m_points.size() > m_maxpoints)
+    {
+        std::vector<size_t> sel = lttb_select(m_x, m_y, m_maxpoints);
+
+        if (gopt_verbose >= 1)
+            OUT("Downsampled series from " << m_points.size()
+                << " to " << sel.size() << " points.");
+
+        for (size_t i = 0; i < sel.size(); ++i)
+            out += m_points[sel[i]];
+    }
+    else
+    {
+        for (size_t i = 0; i < m_points.size(); ++i)
+            out += m_points[i];
+    }
+
+    m_points.clear();
+    m_x.clear(), m_y.clear();
+    m_numeric = true;
+
+    return out;
+}
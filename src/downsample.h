@@ -0,0 +1,73 @@
+/******************************************************************************
+ * src/downsample.h
+ *
+ * Largest-Triangle-Three-Buckets downsampling of plot series.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef DOWNSAMPLE_HEADER
+#define DOWNSAMPLE_HEADER
+
+#include <string>
+#include <vector>
+
+//! Select at most maxpoints indexes of the series (x,y) which preserve its
+//! visual shape using Largest-Triangle-Three-Buckets. The first and last
+//! points are always kept.
+std::vector<size_t> lttb_select(const std::vector<double>& x,
+                                const std::vector<double>& y,
+                                size_t maxpoints);
+
+//! Parse the value of a "maxpoints=N" modifier.
+size_t parse_maxpoints(const std::string& modifier);
+
+//! Formatted points of one plot series, which are reduced to at most
+//! maxpoints when the series is complete. Without a limit the points are
+//! only concatenated.
+class PlotSeries
+{
+protected:
+    //! maximum number of points, 0 for unlimited
+    size_t m_maxpoints;
+
+    //! concatenated points without limit
+    std::string m_text;
+
+    //! formatted points with limit
+    std::vector<std::string> m_points;
+
+    //! numeric coordinates of points with limit
+    std::vector<double> m_x, m_y;
+
+    //! false if a coordinate is not a number, disables downsampling
+    bool m_numeric;
+
+public:
+    explicit PlotSeries(size_t maxpoints = 0)
+        : m_maxpoints(maxpoints), m_numeric(true)
+    { }
+
+    //! append a formatted point with coordinates x and y
+    void add(const std::string& x, const std::string& y,
+             const std::string& point);
+
+    //! return the concatenated, possibly downsampled points and clear series
+    std::string str();
+};
+
+#endif // DOWNSAMPLE_HEADER
@@ -119,8 +119,12 @@ void FieldSet::check_detect()
 //! add new field (key,value), detect the value type and augment found type
 void FieldSet::add_field(const std::string& key, const std::string& value)
 {
-    fieldtype t = detect(value);
+    add_field(key, detect(value));
+}
 
+//! add new field key of type t, or augment type of existing field
+void FieldSet::add_field(const std::string& key, fieldtype t)
+{
     for (fieldset_type::iterator fi = m_fieldset.begin();
          fi != m_fieldset.end(); ++fi)
     {
@@ -137,6 +141,16 @@ void FieldSet::add_field(const std::string& key, const std::string& value)
     m_fieldset.push_back( sfpair_type(key,t) );
 }
 
+//! add all fields of another field set
+void FieldSet::add_fields(const FieldSet& other)
+{
+    for (fieldset_type::const_iterator fi = other.m_fieldset.begin();
+         fi != other.m_fieldset.end(); ++fi)
+    {
+        add_field(fi->first, fi->second);
+    }
+}
+
 //! return CREATE TABLE for the given fieldset
 std::string FieldSet::make_create_table(const std::string& tablename, bool temporary) const
 {
@@ -64,6 +64,24 @@ public:
     //! add new field (key,value), detect the value type and augment found type
     void add_field(const std::string& key, const std::string& value);
 
+    //! add new field key of type t, or augment type of existing field
+    void add_field(const std::string& key, fieldtype t);
+
+    //! add all fields of another field set
+    void add_fields(const FieldSet& other);
+
+    //! return key of i-th field
+    inline const std::string& key(size_t i) const
+    {
+        return m_fieldset[i].first;
+    }
+
+    //! return detected type of i-th field
+    inline fieldtype type(size_t i) const
+    {
+        return m_fieldset[i].second;
+    }
+
     //! return CREATE TABLE for the given fieldset
     std::string make_create_table(const std::string& tablename, bool temporary) const;
 };
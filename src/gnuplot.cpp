@@ -39,6 +39,10 @@
 #include "strtools.h"
 #include "sql.h"
 #include "textlines.h"
+#include "profile.h"
+#include "sqlpool.h"
+#include "plan.h"
+#include "downsample.h"
 #include "importdata.h"
 
 class SpGnuplot
@@ -52,7 +56,8 @@ public:
 
     // *** current gnuplot datafile ***
 
-    std::ostream* m_datafile;
+    //! contents of the datafile, written when processing is finished
+    std::ostringstream m_datafile;
     std::string m_datafilename;
     unsigned int m_dataindex;
 
@@ -96,6 +101,15 @@ public:
     //! Process # MACRO commands
     void macro(size_t ln, size_t indent, const std::string& cmdline);
 
+    //! Return the SQL query run by a read-only directive, or an empty string
+    //! for all other keywords.
+    static std::string directive_query(const std::string& first_word,
+                                       const std::string& cmd,
+                                       std::string::size_type space_pos);
+
+    //! plans the queries of each segment between barriers
+    DocumentPlanner<comment_char> m_planner;
+
     //! Process TextLines
     int process();
 
@@ -133,6 +147,64 @@ bool SpGnuplot::connect(size_t /* ln */, size_t /* indent */, const std::string&
     return g_db_connect(cmdline);
 }
 
+//! match plot lines "'file' index N[ title "text"] properties[, \]" like
+//! regex "[[:blank:]]*'[^']+' index [0-9]+( title \"[^\"]*\")?( .*?)(, \\)?[[:blank:]]*"
+//! in linear time, returns the second group and whether the third matched.
+static inline bool
+match_plot_line(const std::string& line, std::string& props, bool& cont)
+{
+    static const std::string index = " index ", title = " title \"";
+
+    size_t p = skip_blanks(line);
+    if (p >= line.size() || line[p] != '\'')
+        return false;
+
+    size_t q = line.find('\'', p + 1);
+    if (q == std::string::npos || q == p + 1)
+        return false;
+    p = q + 1;
+
+    if (line.compare(p, index.size(), index) != 0)
+        return false;
+    p += index.size();
+
+    size_t d = p;
+    while (d < line.size() && line[d] >= '0' && line[d] <= '9') ++d;
+    if (d == p)
+        return false;
+    p = d;
+
+    // the title is only split off if a space follows it
+    if (line.compare(p, title.size(), title) == 0)
+    {
+        size_t t = line.find('"', p + title.size());
+        if (t != std::string::npos && t + 1 < line.size() && line[t + 1] == ' ')
+            p = t + 1;
+    }
+
+    if (p >= line.size() || line[p] != ' ')
+        return false;
+
+    // shortest properties followed by an optional ", \" and blanks
+    size_t e = line.size();
+    while (e > p && isblank((unsigned char)line[e - 1])) --e;
+
+    cont = (e >= p + 4 && line.compare(e - 3, 3, ", \\") == 0);
+    if (cont) e -= 3;
+
+    props = line.substr(p, std::max(e, p + 1) - p);
+    return true;
+}
+
+//! match "[^=]+ = .*" in linear time
+static inline bool
+match_macro(const std::string& line)
+{
+    size_t f = line.find('=');
+    return f != std::string::npos && f >= 2 &&
+           line[f - 1] == ' ' && f + 1 < line.size() && line[f + 1] == ' ';
+}
+
 //! Helper to rewrite Gnuplot "plot" directives with new datafile/index pairs
 void SpGnuplot::plot_rewrite(size_t ln, size_t indent,
                              const std::vector<Dataset>& datasets,
@@ -171,8 +243,8 @@ void SpGnuplot::plot_rewrite(size_t ln, size_t indent,
     }
 
     // scan following lines for plot descriptions
-    static const boost::regex re_line("[[:blank:]]*'[^']+' index [0-9]+( title \"[^\"]*\")?( .*?)(, \\\\)?[[:blank:]]*");
-    boost::smatch rm;
+    std::string props;
+    bool cont;
 
     if (datasets.size())
         oss << "plot";
@@ -181,7 +253,7 @@ void SpGnuplot::plot_rewrite(size_t ln, size_t indent,
     size_t entry = 0; // dataset entry
 
     while (eln < m_lines.size() &&
-           boost::regex_match(m_lines[eln], rm, re_line))
+           match_plot_line(m_lines[eln], props, cont))
     {
         ++eln;
 
@@ -197,12 +269,12 @@ void SpGnuplot::plot_rewrite(size_t ln, size_t indent,
                 oss << " title \"" << datasets[entry].title << '"';
 
             // output extended properties
-            oss << rm[2];
+            oss << props;
 
             ++entry;
 
             // break if no \ was found at the end
-            if (rm[3].length() == 0) break;
+            if (!cont) break;
         }
         else
         {
@@ -231,28 +303,66 @@ void SpGnuplot::plot_rewrite(size_t ln, size_t indent,
     m_lines.replace(ln, eln, indent, oss.str(), plot_type);
 }
 
+//! Parse PLOT[(modifiers)] command into query and maxpoints modifier
+static void parse_plot(const std::string& cmdline, std::string& query,
+                       size_t& maxpoints)
+{
+    static const boost::regex
+        re_plot("PLOT(?:\\(([^)]*)\\))? (.+)");
+    boost::smatch rm_plot;
+
+    if (!boost::regex_match(cmdline, rm_plot, re_plot))
+        OUT_THROW("PLOT requires a query.");
+
+    query = rm_plot[2].str();
+    maxpoints = 0;
+
+    std::vector<std::string> modifiers = split(rm_plot[1].str(), '|');
+    for (size_t i = 0; i < modifiers.size(); ++i)
+    {
+        std::string& modifier = trim_inplace_ws(modifiers[i]);
+        if (modifier.empty()) continue;
+
+        if (is_prefix(modifier, "maxpoints="))
+            maxpoints = parse_maxpoints(modifier);
+        else
+            OUT_THROW("PLOT failed: unknown modifier '" + modifier + "'");
+    }
+}
+
 //! Process # PLOT commands
 void SpGnuplot::plot(size_t ln, size_t indent, const std::string& cmdline)
 {
-    SqlQuery sql = g_db->query(cmdline);
+    std::string query;
+    size_t maxpoints;
+    parse_plot(cmdline, query, maxpoints);
+
+    SqlQuery sql = g_db->query(query);
 
     // write a header to the datafile containing the query
-    std::ostream& df = *m_datafile;
+    std::ostream& df = m_datafile;
+    std::streampos df_start = df.tellp();
 
     df << std::string(80, '#') << std::endl
-       << "# PLOT " << cmdline << std::endl
+       << "# " << cmdline << std::endl
        << '#' << std::endl;
 
     // write result data rows
+    PlotSeries series(maxpoints);
     while (sql->step())
     {
+        std::string row;
         for (unsigned int col = 0; col < sql->num_cols(); ++col)
         {
-            if (col != 0) df << '\t';
-            df << sql->text(col);
+            if (col != 0) row += '\t';
+            row += sql->text(col);
         }
-        df << std::endl;
+        row += '\n';
+
+        series.add(sql->text(0),
+                   sql->num_cols() >= 2 ? sql->text(1) : "", row);
     }
+    df << series.str();
 
     // append plot line to gnuplot
     std::vector<Dataset> datasets(1);
@@ -263,11 +373,18 @@ void SpGnuplot::plot(size_t ln, size_t indent, const std::string& cmdline)
     df << std::endl << std::endl;
     ++m_dataindex;
 
+    // count data file bytes for --profile
+    if (Profile::Record* r = profile_record())
+        r->bytes += df.tellp() - df_start;
+
     plot_rewrite(ln, indent, datasets, "PLOT");
 }
 
-//! Process # MULTIPLOT commands
-void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
+//! Parse MULTIPLOT(fields[|maxpoints=N]) command into query, group fields
+//! and maxpoints modifier
+static void parse_multiplot(const std::string& cmdline, std::string& query,
+                            std::vector<std::string>& groupfields,
+                            size_t& maxpoints)
 {
     // extract MULTIPLOT columns
     static const boost::regex
@@ -278,12 +395,33 @@ void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
         OUT_THROW("MULTIPLOT() requires group column list.");
 
     std::string multiplot = rm_multiplot[1].str();
-    std::string query = rm_multiplot[2].str();
+    query = rm_multiplot[2].str();
+    maxpoints = 0;
+
+    std::string::size_type bar = multiplot.rfind('|');
+    if (bar != std::string::npos)
+    {
+        std::string modifier = trim(multiplot.substr(bar + 1));
+        if (!is_prefix(modifier, "maxpoints="))
+            OUT_THROW("MULTIPLOT failed: unknown modifier '|" + modifier + "'");
+
+        maxpoints = parse_maxpoints(modifier);
+        multiplot.resize(bar);
+    }
 
     query = replace_all(query, "MULTIPLOT", multiplot);
 
-    std::vector<std::string> groupfields = split(multiplot, ',');
+    groupfields = split(multiplot, ',');
     std::for_each(groupfields.begin(), groupfields.end(), trim_inplace_ws);
+}
+
+//! Process # MULTIPLOT commands
+void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
+{
+    std::string query;
+    std::vector<std::string> groupfields;
+    size_t maxpoints;
+    parse_multiplot(cmdline, query, groupfields, maxpoints);
 
     // execute query
     SqlQuery sql = g_db->query(query);
@@ -324,7 +462,8 @@ void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
     }
 
     // write a header to the datafile containing the query
-    std::ostream& df = *m_datafile;
+    std::ostream& df = m_datafile;
+    std::streampos df_start = df.tellp();
 
     df << std::string(80, '#') << std::endl
        << "# " << cmdline << std::endl
@@ -333,6 +472,7 @@ void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
     // collect coordinates groups
     {
         std::vector<std::string> lastgroup;
+        PlotSeries series(maxpoints);
         size_t rows = 0;
 
         while (sql->step())
@@ -347,7 +487,7 @@ void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
             {
                 // group fields mismatch (or first row) -> start new group
                 if (sql->current_row() != 0) {
-                    df << std::endl << std::endl;
+                    df << series.str() << std::endl << std::endl;
                     ++m_dataindex;
                 }
 
@@ -375,23 +515,25 @@ void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
             }
 
             // group fields match with last row -> append coordinates.
-            df << sql->text(col_x)
-               << '\t' << sql->text(col_y);
+            std::string row = sql->text(col_x) + '\t' + sql->text(col_y);
 
             if (have_xerrorbars) {
-                df << '\t' << sql->text(col_xmin)
-                   << '\t' << sql->text(col_xmax);
+                row += '\t' + sql->text(col_xmin)
+                    + '\t' + sql->text(col_xmax);
             }
             if (have_yerrorbars) {
-                df << '\t' << sql->text(col_ymin)
-                   << '\t' << sql->text(col_ymax);
+                row += '\t' + sql->text(col_ymin)
+                    + '\t' + sql->text(col_ymax);
             }
 
-            df << std::endl;
+            row += '\n';
+            series.add(sql->text(col_x), sql->text(col_y), row);
 
             ++rows;
         }
 
+        df << series.str();
+
         if (rows == 0)
             df << "- # (no data rows)" << std::endl;
 
@@ -400,6 +542,10 @@ void SpGnuplot::multiplot(size_t ln, size_t indent, const std::string& cmdline)
         ++m_dataindex;
     }
 
+    // count data file bytes for --profile
+    if (Profile::Record* r = profile_record())
+        r->bytes += df.tellp() - df_start;
+
     plot_rewrite(ln, indent, datasets, "MULTIPLOT");
 }
 
@@ -429,11 +575,8 @@ void SpGnuplot::macro(size_t ln, size_t indent, const std::string& cmdline)
     }
 
     // scan following lines for macro defintions
-    static const boost::regex re_macro("[^=]+ = .*");
-
     size_t eln = ln;
-    while (eln < m_lines.size() &&
-           boost::regex_match(m_lines[eln], re_macro))
+    while (eln < m_lines.size() && match_macro(m_lines[eln]))
     {
         ++eln;
     }
@@ -441,11 +584,40 @@ void SpGnuplot::macro(size_t ln, size_t indent, const std::string& cmdline)
     m_lines.replace(ln, eln, indent, oss.str(), "MACRO");
 }
 
+//! Return the SQL query run by a read-only directive
+std::string SpGnuplot::directive_query(const std::string& first_word,
+                                       const std::string& cmd,
+                                       std::string::size_type space_pos)
+{
+    if (first_word == "MACRO")
+    {
+        return cmd.substr(space_pos+1);
+    }
+    else if (first_word == "PLOT")
+    {
+        std::string query;
+        size_t maxpoints;
+        parse_plot(cmd, query, maxpoints);
+        return query;
+    }
+    else if (first_word == "MULTIPLOT")
+    {
+        std::string query;
+        std::vector<std::string> groupfields;
+        size_t maxpoints;
+        parse_multiplot(cmd, query, groupfields, maxpoints);
+        return query;
+    }
+    return std::string();
+}
+
 //! process line-based file in place
 int SpGnuplot::process()
 {
     bool active_range = gopt_ranges.size() ? false : true;
 
+    m_planner.prepare(0, active_range);
+
     // iterate over all lines
     for (size_t ln = 0; ln < m_lines.size();)
     {
@@ -508,33 +680,41 @@ int SpGnuplot::process()
         else if (first_word == "SQL")
         {
             OUT(ln << "# " << cmd);
+            ProfileDirective profile(ln, first_word);
             sql(ln, indent, cmd.substr(space_pos+1));
+            m_planner.barrier(ln, active_range);
         }
         else if (first_word == "IMPORT-DATA")
         {
             OUT(ln << "# " << cmd);
+            ProfileDirective profile(ln, first_word);
 	    if (importdata(ln, indent, cmd) != EXIT_SUCCESS)
 	      return EXIT_FAILURE;
+            m_planner.barrier(ln, active_range);
         }
         else if (first_word == "CONNECT")
         {
             OUT(ln << "# " << cmd);
 	    if (!connect(ln, indent, cmd.substr(space_pos+1)))
 	      return EXIT_FAILURE;
+            m_planner.barrier(ln, active_range);
         }
         else if (first_word == "PLOT")
         {
             OUT(ln << "# " << cmd);
-            plot(ln, indent, cmd.substr(space_pos+1));
+            ProfileDirective profile(ln, first_word);
+            plot(ln, indent, cmd);
         }
         else if (first_word == "MULTIPLOT")
         {
             OUT(ln << "# " << cmd);
+            ProfileDirective profile(ln, first_word);
             multiplot(ln, indent, cmd);
         }
         else if (first_word == "MACRO")
         {
             OUT(ln << "# " << cmd);
+            ProfileDirective profile(ln, first_word);
             macro(ln, indent, cmd.substr(space_pos+1));
         }
         else
@@ -548,7 +728,7 @@ int SpGnuplot::process()
 
 //! process a stream
 SpGnuplot::SpGnuplot(const std::string& filename, TextLines& lines)
-    : m_lines(lines)
+    : m_lines(lines), m_planner(lines, &SpGnuplot::directive_query)
 {
     // construct output data file
     m_datafilename = filename;
@@ -557,26 +737,11 @@ SpGnuplot::SpGnuplot(const std::string& filename, TextLines& lines)
         m_datafilename = m_datafilename.substr(0, dotpos);
     m_datafilename += "-data.txt";
 
-    // open output data file
-    if (!gopt_check_output)
-    {
-        m_datafile = new std::ofstream(m_datafilename.c_str());
-        if (!m_datafile->good()) {
-            OUT("Fatal error opening datafile " << m_datafilename << ": " << strerror(errno));
-            delete m_datafile;
-            return;
-        }
-    }
-    else
-    {
-        // open temporary data file
-        m_datafile = new std::ostringstream();
-    }
     m_dataindex = 0;
 
     // write data file preamble
     {
-        std::ostream& df = *m_datafile;
+        std::ostream& df = m_datafile;
 
         df << std::string(80, '#') << std::endl
            << '#' << std::endl
@@ -603,12 +768,10 @@ SpGnuplot::SpGnuplot(const std::string& filename, TextLines& lines)
         }
         std::string checkdata = read_stream(in);
 
-        std::ostringstream* oss = (std::ostringstream*)m_datafile;
-
-        if (checkdata != oss->str())
+        if (checkdata != m_datafile.str())
         {
             OUT("Mismatch to expected output data file:");
-            simple_diff(oss->str(), checkdata);
+            simple_diff(m_datafile.str(), checkdata);
             OUT_THROW("Mismatch to expected output data file " << m_datafilename);
         }
         else
@@ -616,8 +779,10 @@ SpGnuplot::SpGnuplot(const std::string& filename, TextLines& lines)
             OUT("Good match to expected output data file " << m_datafilename);
         }
     }
-
-    delete m_datafile;
+    else if (!write_file_if_changed(m_datafilename, m_datafile.str()))
+    {
+        OUT("Datafile " << m_datafilename << " is unchanged, not rewritten.");
+    }
 }
 
 //! Process Gnuplot file
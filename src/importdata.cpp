@@ -39,8 +39,7 @@
 #include "common.h"
 
 //! check for RESULT line, returns offset of key=values
-static inline size_t
-is_result_line(const std::string& line)
+size_t ImportData::is_result_line(const std::string& line)
 {
     if (line.substr(0,6) == "RESULT" && isblank(line[6]))
         return 7;
@@ -55,8 +54,8 @@ is_result_line(const std::string& line)
 }
 
 //! split a string into "key=value" parts at TABs or spaces.
-static inline std::vector<std::string>
-split_result_line(const std::string& str)
+std::vector<std::string>
+ImportData::split_result_line(const std::string& str)
 {
     std::vector<std::string> out;
 
@@ -85,10 +84,9 @@ split_result_line(const std::string& str)
 }
 
 //! split a "key=value" string into key and value parts
-static inline void
-split_keyvalue(const std::string& field, size_t col,
-               std::string& key, std::string& value,
-               bool opt_colnums = false)
+void ImportData::split_keyvalue(const std::string& field, size_t col,
+                                std::string& key, std::string& value,
+                                bool opt_colnums)
 {
     std::string::size_type eqpos = field.find('=');
     if (eqpos == std::string::npos)
@@ -113,8 +111,8 @@ split_keyvalue(const std::string& field, size_t col,
 }
 
 //! deduplicate key names by appending numbers
-static inline std::string
-dedup_key(const std::string& key, std::set<std::string>& keyset)
+std::string
+ImportData::dedup_key(const std::string& key, std::set<std::string>& keyset)
 {
     // unique key
     if (keyset.find(key) == keyset.end())
@@ -467,6 +465,11 @@ ImportData::ImportData(bool temporary_table)
 {
 }
 
+//! virtual destructor for derived line processors
+ImportData::~ImportData()
+{
+}
+
 //! define identifiers for command line arguments
 enum { OPT_HELP, OPT_VERBOSE,
        OPT_FIRSTLINE, OPT_ALL_LINES, OPT_NO_DUPLICATE,
@@ -629,6 +632,10 @@ int ImportData::main(int argc, char* argv[])
     // finish transaction
     g_db->execute("COMMIT");
 
+    // update planner statistics, imported tables are usually queried a lot
+    if (m_total_count != 0)
+        g_db->analyze(m_tablename);
+
     OUT("Imported in total " << m_total_count << " rows of data containing " << m_fieldset.count() << " fields each.");
 
     if (opt_dbconnect)
@@ -83,6 +83,24 @@ public:
     //! initializing constructor
     ImportData(bool temporary_table = false);
 
+    //! virtual destructor for derived line processors
+    virtual ~ImportData();
+
+    //! check for RESULT line, returns offset of key=values
+    static size_t is_result_line(const std::string& line);
+
+    //! split a string into "key=value" parts at TABs or spaces.
+    static std::vector<std::string> split_result_line(const std::string& str);
+
+    //! split a "key=value" string into key and value parts
+    static void split_keyvalue(const std::string& field, size_t col,
+                               std::string& key, std::string& value,
+                               bool opt_colnums = false);
+
+    //! deduplicate key names by appending numbers
+    static std::string dedup_key(const std::string& key,
+                                 std::set<std::string>& keyset);
+
     //! returns true if the give table exists.
     static bool exist_table(const std::string& table);
 
@@ -93,7 +111,7 @@ public:
     bool insert_line(const std::string& line);
 
     //! process a line: cache lines or insert directly.
-    bool process_line(const std::string& line);
+    virtual bool process_line(const std::string& line);
 
     //! process an input stream and split into lines
     void process_stream(FILE* in, const char* fname);
@@ -39,6 +39,11 @@
 #include "strtools.h"
 #include "sql.h"
 #include "textlines.h"
+#include "profile.h"
+#include "sqlpool.h"
+#include "plan.h"
+#include "docstate.h"
+#include "downsample.h"
 #include "importdata.h"
 #include "reformat.h"
 
@@ -78,9 +83,41 @@ public:
     //! Process % TEXTTABLE commands
     void texttable(size_t ln, size_t indent, const std::string& cmdline);
 
+    //! Parsed % PLOT command: optional modifiers and query
+    struct Plot
+    {
+        //! SQL query
+        std::string query;
+
+        //! maxpoints modifier, or 0
+        size_t maxpoints;
+
+        //! parse PLOT[(modifiers)] command line
+        explicit Plot(const std::string& cmdline);
+    };
+
     //! Process % PLOT commands
     void plot(size_t ln, size_t indent, const std::string& cmdline);
 
+    //! Parsed % MULTIPLOT command: group fields, modifiers and query
+    struct Multiplot
+    {
+        //! MULTIPLOT(...) group fields without modifiers
+        std::vector<std::string> groupfields;
+
+        //! SQL query with MULTIPLOT replaced by the group fields
+        std::string query;
+
+        //! modifier marks
+        bool attr_mark, attrplus_mark, title_mark, ptitle_mark, nolegend_mark;
+
+        //! maxpoints modifier, or 0
+        size_t maxpoints;
+
+        //! parse MULTIPLOT(fields|modifiers) command line
+        explicit Multiplot(const std::string& cmdline);
+    };
+
     //! Process % MULTIPLOT commands
     void multiplot(size_t ln, size_t indent, const std::string& cmdline);
 
@@ -91,15 +128,140 @@ public:
                  const std::string& op_name,
                  const std::string& separator,
                  const std::string& endline,
-                 const std::string& gobble_regex);
+                 const boost::regex& re_gobble);
 
     //! Process % DEFMACRO commands
     void defmacro(size_t ln, size_t indent, const std::string& cmdline);
 
+    //! Return the SQL query run by a read-only directive, or an empty string
+    //! for all other keywords.
+    static std::string directive_query(const std::string& first_word,
+                                       const std::string& cmd,
+                                       std::string::size_type space_pos);
+
+    //! plans the queries of each segment between barriers
+    DocumentPlanner<comment_char> m_planner;
+
+    //! Process a SQL, IMPORT-DATA or CONNECT directive ending before ln.
+    void barrier(size_t ln, size_t indent, const std::string& cmd,
+                 bool active_range);
+
+    //! state of directives from the last run, NULL unless incremental
+    DocumentState* m_state;
+
+    //! SQL, IMPORT-DATA or CONNECT directive deferred in incremental mode
+    struct Barrier
+    {
+        size_t ln, indent;
+        std::string cmd;
+    };
+
+    //! deferred barriers, run before the next changed directive
+    std::vector<Barrier> m_deferred;
+
+    //! Return the lines from ln up to the next directive, which contain the
+    //! output of the directive ending before ln.
+    std::string output_lines(size_t ln);
+
+    //! Check whether the directive ending before ln is unchanged since the
+    //! last run, otherwise run the deferred barriers it may depend on.
+    bool skip_unchanged(size_t ln, const std::string& cmd, bool active_range);
+
+    //! Save state of all directives after processing.
+    void save_state();
+
     //! Process Textlines
-    SpLatex(TextLines& lines);
+    SpLatex(TextLines& lines, DocumentState* state = NULL);
 };
 
+//! match "[[:blank:]]*(\\addplot.*coordinates \{)[^}]+(\}[^;]*;.*)" or, if
+//! semicolon_next, "...(\};.*)" in linear time and return the two groups.
+static inline bool
+match_addplot(const std::string& line, bool semicolon_next,
+              std::string& head, std::string& tail)
+{
+    static const std::string addplot = "\\addplot", coords = "coordinates {";
+
+    size_t b = skip_blanks(line);
+    if (line.compare(b, addplot.size(), addplot) != 0)
+        return false;
+
+    size_t last_semicolon = line.rfind(';');
+    if (last_semicolon == std::string::npos)
+        return false;
+
+    // scan backwards for the last "coordinates {" which the rest matches,
+    // keeping the position of the nearest closing brace after it.
+    size_t close = std::string::npos;
+
+    for (size_t i = line.size(); i-- > b + addplot.size(); )
+    {
+        if (line[i] == '}') {
+            close = i;
+            continue;
+        }
+        if (line.compare(i, coords.size(), coords) != 0)
+            continue;
+
+        size_t p = i + coords.size();
+        if (close == std::string::npos || close == p)
+            continue;
+
+        if (semicolon_next ? close + 1 < line.size() && line[close + 1] == ';'
+            : close < last_semicolon)
+        {
+            head = line.substr(b, p - b);
+            tail = line.substr(close);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//! match "[[:blank:]]*((?:%[[:blank:]]*)?\\addlegendentry\{).*(\};.*)" in
+//! linear time and return the two groups.
+static inline bool
+match_legend(const std::string& line, std::string& head, std::string& tail)
+{
+    static const std::string legend = "\\addlegendentry{";
+
+    size_t b = skip_blanks(line), p = b;
+    if (p < line.size() && line[p] == '%')
+        p = skip_blanks(line, p + 1);
+
+    if (line.compare(p, legend.size(), legend) != 0)
+        return false;
+    p += legend.size();
+
+    size_t t = line.rfind("};");
+    if (t == std::string::npos || t < p)
+        return false;
+
+    head = line.substr(b, p - b);
+    tail = line.substr(t);
+    return true;
+}
+
+//! match "[[:blank:]]*\\def\\[^{]+\{[^}]+\}.*" in linear time
+static inline bool
+match_defmacro(const std::string& line)
+{
+    static const std::string def = "\\def\\";
+
+    size_t p = skip_blanks(line);
+    if (line.compare(p, def.size(), def) != 0)
+        return false;
+    p += def.size();
+
+    size_t open = line.find('{', p);
+    if (open == std::string::npos || open == p)
+        return false;
+
+    size_t close = line.find('}', open + 1);
+    return close != std::string::npos && close != open + 1;
+}
+
 //! Process % SQL commands
 void SpLatex::sql(size_t /* ln */, size_t /* indent */, const std::string& cmdline)
 {
@@ -151,14 +313,43 @@ void SpLatex::texttable(size_t ln, size_t indent, const std::string& cmdline)
     }
 }
 
+//! parse PLOT[(modifiers)] command line
+SpLatex::Plot::Plot(const std::string& cmdline)
+    : maxpoints(0)
+{
+    static const boost::regex
+        re_plot("PLOT(?:\\(([^)]*)\\))? (.+)");
+    boost::smatch rm_plot;
+
+    if (!boost::regex_match(cmdline, rm_plot, re_plot))
+        OUT_THROW("PLOT requires a query.");
+
+    query = rm_plot[2].str();
+
+    std::vector<std::string> modifiers = split(rm_plot[1].str(), '|');
+    for (size_t i = 0; i < modifiers.size(); ++i)
+    {
+        std::string& modifier = trim_inplace_ws(modifiers[i]);
+        if (modifier.empty()) continue;
+
+        if (is_prefix(modifier, "maxpoints="))
+            maxpoints = parse_maxpoints(modifier);
+        else
+            OUT_THROW("PLOT failed: unknown modifier '" + modifier + "'");
+    }
+}
+
 //! Process % PLOT commands
 void SpLatex::plot(size_t ln, size_t indent, const std::string& cmdline)
 {
-    SqlQuery sql = g_db->query(cmdline);
+    Plot pl(cmdline);
 
-    std::ostringstream oss;
+    SqlQuery sql = g_db->query(pl.query);
+
+    PlotSeries series(pl.maxpoints);
     while (sql->step())
     {
+        std::ostringstream oss;
         oss << " (";
         for (unsigned int col = 0; col < sql->num_cols(); ++col)
         {
@@ -166,28 +357,35 @@ void SpLatex::plot(size_t ln, size_t indent, const std::string& cmdline)
             oss << str_reduce(sql->text(col));
         }
         oss << ')';
+
+        if (sql->num_cols() >= 2)
+            series.add(sql->text(0), sql->text(1), oss.str());
+        else
+            series.add(sql->text(0), "", oss.str());
     }
+    std::string coordinates = series.str();
 
     // check whether line contains an \addplot command
-    static const boost::regex
-        re_addplot("[[:blank:]]*(\\\\addplot.*coordinates \\{)[^}]+(\\}[^;]*;.*)");
-    boost::smatch rm;
+    std::string head, tail;
 
     if (ln < m_lines.size() &&
-        boost::regex_match(m_lines[ln], rm, re_addplot))
+        match_addplot(m_lines[ln], false, head, tail))
     {
-        std::string output = rm[1].str() + oss.str() + " " + rm[2].str();
+        std::string output = head + coordinates + " " + tail;
         m_lines.replace(ln, ln+1, indent, output, "PLOT");
     }
     else
     {
-        std::string output = "\\addplot coordinates {" + oss.str() + " };";
+        std::string output = "\\addplot coordinates {" + coordinates + " };";
         m_lines.replace(ln, ln, indent, output, "PLOT");
     }
 }
 
-//! Process % MULTIPLOT commands
-void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
+//! parse MULTIPLOT(fields|modifiers) command line
+SpLatex::Multiplot::Multiplot(const std::string& cmdline)
+    : attr_mark(false), attrplus_mark(false),
+      title_mark(false), ptitle_mark(false), nolegend_mark(false),
+      maxpoints(0)
 {
     // extract MULTIPLOT columns
     static const boost::regex
@@ -198,18 +396,11 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
         OUT_THROW("MULTIPLOT() requires group column list.");
 
     std::string multiplot = rm_multiplot[1].str();
-    std::string query = rm_multiplot[2].str();
+    query = rm_multiplot[2].str();
 
-    std::vector<std::string> groupfields = split(multiplot, ',');
+    groupfields = split(multiplot, ',');
     std::for_each(groupfields.begin(), groupfields.end(), trim_inplace_ws);
 
-    bool attr_mark = false;
-    bool attrplus_mark = false;
-    bool title_mark = false;
-    bool ptitle_mark = false;
-    bool nolegend_mark = false;
-    bool xerr = false, yerr = false;
-
     while (!groupfields.empty() && groupfields.back().find('|') != std::string::npos) {
         std::string& field = groupfields.back();
         if (!groupfields.empty() && is_suffix(field, "|title")) {
@@ -243,15 +434,38 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
             attr_mark = true;
             attrplus_mark = true;
         }
+        else if (is_prefix(field.substr(field.rfind('|') + 1), "maxpoints=")) {
+            // remove |maxpoints=N from multiplot string
+            std::string modifier = field.substr(field.rfind('|'));
+            maxpoints = parse_maxpoints(modifier.substr(1));
+            field.resize(field.size() - modifier.size());
+            multiplot.resize(multiplot.size() - modifier.size());
+        }
         else {
             std::string modifier = field.substr(field.find('|'));
             OUT_THROW("MULTIPLOT failed: unknown modifier '" + modifier + "'");
         }
     }
 
-    // execute query
     query = replace_all(query, "MULTIPLOT", multiplot);
-    SqlQuery sql = g_db->query(query);
+}
+
+//! Process % MULTIPLOT commands
+void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
+{
+    Multiplot mp(cmdline);
+
+    const std::vector<std::string>& groupfields = mp.groupfields;
+
+    bool attr_mark = mp.attr_mark;
+    bool attrplus_mark = mp.attrplus_mark;
+    bool title_mark = mp.title_mark;
+    bool ptitle_mark = mp.ptitle_mark;
+    bool nolegend_mark = mp.nolegend_mark;
+    bool xerr = false, yerr = false;
+
+    // execute query
+    SqlQuery sql = g_db->query(mp.query);
 
     // read column names
     sql->read_colmap();
@@ -311,7 +525,7 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
 
     {
         std::vector<std::string> lastgroup;
-        std::ostringstream coord;
+        PlotSeries coord(mp.maxpoints);
 
         while (sql->step())
         {
@@ -335,10 +549,8 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
             if (row == 0 || lastgroup != rowgroup)
             {
                 // group fields mismatch (or first row) -> start new group
-                if (row != 0) {
+                if (row != 0)
                     coordlist.push_back(coord.str());
-                    coord.str("");
-                }
 
                 lastgroup  = rowgroup;
 
@@ -365,19 +577,22 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
             }
 
             // group fields match with last row -> append coordinates.
-            coord << " (" << str_reduce(sql->text(col_x))
+            std::ostringstream point;
+            point << " (" << str_reduce(sql->text(col_x))
                   <<  ',' << str_reduce(sql->text(col_y))
                   <<  ')';
             if (xerr || yerr) {
-                coord << " +- (" << (xerr ? str_reduce(sql->text(col_xerr)) : "0")
+                point << " +- (" << (xerr ? str_reduce(sql->text(col_xerr)) : "0")
                       << ',' << (yerr ? str_reduce(sql->text(col_yerr)) : "0")
                       << ')';
             }
+            coord.add(sql->text(col_x), sql->text(col_y), point.str());
         }
 
         // store last coordates group
-        if (coord.str().size())
-            coordlist.push_back(coord.str());
+        std::string last = coord.str();
+        if (last.size())
+            coordlist.push_back(last);
     }
 
     assert(coordlist.size() == legendlist.size());
@@ -395,16 +610,11 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
     size_t eln = ln;
     size_t entry = 0; // coordinates/legend entry
 
-    static const boost::regex
-        re_addplot("[[:blank:]]*(\\\\addplot.*coordinates \\{)[^}]+(\\};.*)");
-    static const boost::regex
-        re_legend("[[:blank:]]*((?:%[[:blank:]]*)?\\\\addlegendentry\\{).*(\\};.*)");
-
-    boost::smatch rm;
+    std::string head, tail, lhead, ltail;
 
     // check whether line contains an \addplot command
     while (eln < m_lines.size() &&
-           boost::regex_match(m_lines[eln], rm, re_addplot))
+           match_addplot(m_lines[eln], true, head, tail))
     {
         // copy styles from \addplot line
         if (entry < coordlist.size())
@@ -415,17 +625,17 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
                 if (attrplus_mark)
                     out << "+";
                 out << "[" << attrlist[entry] << "] coordinates {"
-                    << coordlist[entry] << " " << rm[2] << std::endl;
+                    << coordlist[entry] << " " << tail << std::endl;
             } else {
-                out << rm[1] << coordlist[entry] << " " << rm[2] << std::endl;
+                out << head << coordlist[entry] << " " << tail << std::endl;
             }
 
             // check following \addlegendentry
             if (eln+1 < m_lines.size() &&
-                boost::regex_match(m_lines[eln+1], rm, re_legend))
+                match_legend(m_lines[eln+1], lhead, ltail))
             {
                 // copy styles
-                out << rm[1] << legendlist[entry] << rm[2] << std::endl;
+                out << lhead << legendlist[entry] << ltail << std::endl;
                 ++eln;
             }
             else
@@ -444,7 +654,7 @@ void SpLatex::multiplot(size_t ln, size_t indent, const std::string& cmdline)
         {
             // remove \addplot and following \addlegendentry as well.
             if (eln+1 < m_lines.size() &&
-                boost::regex_match(m_lines[eln+1], re_legend))
+                match_legend(m_lines[eln+1], lhead, ltail))
             {
                 // skip thus remove \addlegendentry
                 ++eln;
@@ -488,7 +698,7 @@ void SpLatex::tabular(
     const std::string& op_name,
     const std::string& separator,
     const std::string& endline,
-    const std::string& gobble_regex)
+    const boost::regex& re_gobble)
 {
     std::string query = cmdline;
 
@@ -538,22 +748,21 @@ void SpLatex::tabular(
     while (eln < m_lines.size() && is_comment_line(eln) < 0)
         ++eln;
 
-    const boost::regex
-        re_endtabular("[[:blank:]]*% END " + op_name + " .*");
+    std::string endtabular = "% END " + op_name + " ";
 
     if (eln < m_lines.size() &&
-        boost::regex_match(m_lines[eln], re_endtabular))
+        m_lines[eln].compare(skip_blanks(m_lines[eln]),
+                             endtabular.size(), endtabular) == 0)
     {
         // found END TABULAR
         size_t rln = ln;
         size_t entry = 0;
 
-        const boost::regex re_tabular(gobble_regex);
         boost::smatch rm;
 
         // iterate over tabular lines, copy styles to replacement
         while (entry < tlines.size() && rln < eln &&
-               boost::regex_match(m_lines[rln], rm, re_tabular))
+               boost::regex_match(m_lines[rln], rm, re_gobble))
         {
             tlines[entry++] += rm[1];
             ++rln;
@@ -604,13 +813,8 @@ void SpLatex::defmacro(size_t ln, size_t indent, const std::string& cmdline)
     std::string output = oss.str();
 
     // scan lines forward and gobble all lines containing \def commands
-    static const boost::regex
-        re_defmacro("[[:blank:]]*\\\\def\\\\[^{]+\\{[^}]+\\}.*");
-    boost::smatch rm;
-
     size_t eln = ln;
-    while (eln < m_lines.size() &&
-           boost::regex_match(m_lines[eln], rm, re_defmacro))
+    while (eln < m_lines.size() && match_defmacro(m_lines[eln]))
     {
         ++eln;
     }
@@ -618,12 +822,161 @@ void SpLatex::defmacro(size_t ln, size_t indent, const std::string& cmdline)
     m_lines.replace(ln, eln, indent, output, "DEFMACRO");
 }
 
+//! Return the SQL query run by a read-only directive
+std::string SpLatex::directive_query(const std::string& first_word,
+                                     const std::string& cmd,
+                                     std::string::size_type space_pos)
+{
+    if (first_word == "TEXTTABLE")
+    {
+        return cmd.substr(space_pos+1);
+    }
+    else if (first_word == "PLOT")
+    {
+        return Plot(cmd).query;
+    }
+    else if (first_word == "MULTIPLOT")
+    {
+        return Multiplot(cmd).query;
+    }
+    else if (first_word == "TABULAR" || first_word == "TABTABLE" ||
+             first_word == "DEFMACRO")
+    {
+        std::string query = cmd.substr(space_pos+1);
+        Reformat().parse_query(query);
+        return query;
+    }
+    return std::string();
+}
+
+//! test for keywords of directives which rewrite the lines following them
+static inline bool
+is_output_directive(const std::string& first_word)
+{
+    return (first_word == "TEXTTABLE" || first_word == "PLOT" ||
+            first_word == "MULTIPLOT" || first_word == "TABULAR" ||
+            first_word == "TABTABLE" || first_word == "DEFMACRO");
+}
+
+//! Process a SQL, IMPORT-DATA or CONNECT directive ending before ln.
+void SpLatex::barrier(size_t ln, size_t indent, const std::string& cmd,
+                      bool active_range)
+{
+    std::string::size_type space_pos =
+        cmd.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZ-_");
+    std::string first_word = cmd.substr(0, space_pos);
+
+    OUT(ln << " % " << cmd);
+
+    if (first_word == "SQL")
+    {
+        ProfileDirective profile(ln, first_word);
+        sql(ln, indent, cmd.substr(space_pos+1));
+    }
+    else if (first_word == "IMPORT-DATA")
+    {
+        ProfileDirective profile(ln, first_word);
+        importdata(ln, indent, cmd);
+    }
+    else if (first_word == "CONNECT")
+    {
+        if (!connect(ln, indent, cmd.substr(space_pos+1)))
+            OUT_THROW("Database connection lost.");
+    }
+
+    m_planner.barrier(ln, active_range);
+}
+
+//! Return the lines from ln up to the next directive, which contain the output
+//! of the directive ending before ln.
+std::string SpLatex::output_lines(size_t ln)
+{
+    std::string output;
+
+    while (ln < m_lines.size())
+    {
+        size_t begin = ln;
+        std::string cmd;
+        size_t indent;
+
+        if (m_lines.collect_comment<comment_char>(ln, cmd, indent))
+        {
+            std::string first_word =
+                cmd.substr(0, cmd.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZ-_"));
+
+            if (is_output_directive(first_word) || first_word == "SQL" ||
+                first_word == "IMPORT-DATA" || first_word == "CONNECT" ||
+                first_word == "RANGE")
+                break;
+        }
+
+        for (size_t i = begin; i < ln; ++i)
+            output += m_lines[i] + '\n';
+    }
+
+    return output;
+}
+
+//! Check whether the directive ending before ln is unchanged since the last
+//! run, otherwise run the deferred barriers it may depend on.
+bool SpLatex::skip_unchanged(size_t ln, const std::string& cmd,
+                             bool active_range)
+{
+    if (m_state->unchanged(cmd, output_lines(ln)))
+    {
+        OUT(ln << " % " << cmd);
+        OUT("Unchanged since last run, skipped.");
+        return true;
+    }
+
+    for (size_t i = 0; i < m_deferred.size(); ++i)
+    {
+        const Barrier& b = m_deferred[i];
+        barrier(b.ln, b.indent, b.cmd, active_range);
+    }
+    m_deferred.clear();
+
+    return false;
+}
+
+//! Save state of all directives after processing.
+void SpLatex::save_state()
+{
+    if (m_deferred.size())
+        OUT("Skipped " << m_deferred.size() << " SQL, IMPORT-DATA or CONNECT "
+            "directives not needed by changed directives.");
+
+    std::vector<std::string> outputs;
+
+    for (size_t ln = 0; ln < m_lines.size();)
+    {
+        std::string cmd;
+        size_t indent;
+
+        if (!m_lines.collect_comment<comment_char>(ln, cmd, indent))
+            continue;
+
+        std::string first_word =
+            cmd.substr(0, cmd.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZ-_"));
+
+        if (is_output_directive(first_word))
+            outputs.push_back(output_lines(ln));
+    }
+
+    m_state->save(outputs, g_db->data_version());
+}
+
 //! process line-based file in place
-SpLatex::SpLatex(TextLines& lines)
-    : m_lines(lines)
+SpLatex::SpLatex(TextLines& lines, DocumentState* state)
+    : m_lines(lines), m_planner(lines, &SpLatex::directive_query),
+      m_state(state)
 {
     bool active_range = gopt_ranges.size() ? false : true;
 
+    if (m_state) m_state->begin(g_db->data_version());
+
+    m_planner.prepare(0, active_range);
+
     // iterate over all lines
     for (size_t ln = 0; ln < m_lines.size();)
     {
@@ -683,52 +1036,63 @@ SpLatex::SpLatex(TextLines& lines)
         {
             // skip keywords in non-active ranges
         }
-        else if (first_word == "SQL")
+        else if (first_word == "SQL" || first_word == "IMPORT-DATA" ||
+                 first_word == "CONNECT")
         {
-            OUT(ln << " % " << cmd);
-            sql(ln, indent, cmd.substr(space_pos+1));
-        }
-        else if (first_word == "IMPORT-DATA")
-        {
-            OUT(ln << " % " << cmd);
-            importdata(ln, indent, cmd);
+            if (m_state) {
+                // run only when a following directive has changed
+                m_state->barrier(first_word, cmd);
+
+                Barrier b = { ln, indent, cmd };
+                m_deferred.push_back(b);
+            }
+            else {
+                barrier(ln, indent, cmd, active_range);
+            }
         }
-        else if (first_word == "CONNECT")
+        else if (m_state && is_output_directive(first_word) &&
+                 skip_unchanged(ln, cmd, active_range))
         {
-            OUT(ln << " % " << cmd);
-            if (!connect(ln, indent, cmd.substr(space_pos+1)))
-                OUT_THROW("Database connection lost.");
+            // output lines are kept
         }
         else if (first_word == "TEXTTABLE")
         {
             OUT(ln << " % " << cmd);
+            ProfileDirective profile(ln, first_word);
             texttable(ln, indent, cmd.substr(space_pos+1));
         }
         else if (first_word == "PLOT")
         {
             OUT(ln << " % " << cmd);
-            plot(ln, indent, cmd.substr(space_pos+1));
+            ProfileDirective profile(ln, first_word);
+            plot(ln, indent, cmd);
         }
         else if (first_word == "MULTIPLOT")
         {
             OUT(ln << " % " << cmd);
+            ProfileDirective profile(ln, first_word);
             multiplot(ln, indent, cmd);
         }
         else if (first_word == "TABULAR")
         {
             OUT(ln << " % " << cmd);
+            ProfileDirective profile(ln, first_word);
+            static const boost::regex re_gobble(".*?\\\\\\\\(.*)");
             tabular(ln, indent, cmd.substr(space_pos+1),
-                    "TABULAR", " & ", " \\\\", ".*?\\\\\\\\(.*)");
+                    "TABULAR", " & ", " \\\\", re_gobble);
         }
         else if (first_word == "TABTABLE")
         {
             OUT(ln << " % " << cmd);
+            ProfileDirective profile(ln, first_word);
+            static const boost::regex re_gobble(".*\\t.*()");
             tabular(ln, indent, cmd.substr(space_pos+1),
-                    "TABTABLE", "\t", "", ".*\\t.*()");
+                    "TABTABLE", "\t", "", re_gobble);
         }
         else if (first_word == "DEFMACRO")
         {
             OUT(ln << " % " << cmd);
+            ProfileDirective profile(ln, first_word);
             defmacro(ln, indent, cmd.substr(space_pos+1));
         }
         else
@@ -740,7 +1104,14 @@ SpLatex::SpLatex(TextLines& lines)
 }
 
 //! Process LaTeX file
-void sp_latex(const std::string& /* filename */, TextLines& lines)
+void sp_latex(const std::string& filename, TextLines& lines)
 {
-    SpLatex sp(lines);
+    if (!gopt_incremental) {
+        SpLatex sp(lines);
+        return;
+    }
+
+    DocumentState state(filename);
+    SpLatex sp(lines, &state);
+    sp.save_state();
 }
@@ -21,9 +21,13 @@
  *****************************************************************************/
 
 #include <cerrno>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <unistd.h>
 
@@ -33,6 +37,7 @@
 #include "pgsql.h"
 #include "textlines.h"
 #include "importdata.h"
+#include "profile.h"
 
 //! file type from command line
 static std::string sopt_filetype;
@@ -88,10 +93,189 @@ sp_process_stream(const std::string& filename, std::istream& is)
     return lines;
 }
 
+//! write processed lines to the common output or back to the input file
+static inline void
+sp_write_document(const std::string& filename, const TextLines& lines,
+                  std::ostream* output)
+{
+    if (output)  {
+        // write to common output
+        lines.write_stream(*output);
+    }
+    else {
+        // replace input file, unless the output is identical
+        std::ostringstream oss;
+        lines.write_stream(oss);
+
+        if (!write_file_if_changed(filename, oss.str()))
+            OUT("--- " << filename << " is unchanged, not rewritten.");
+    }
+}
+
+//! A document processed by DocumentJobs in its own session.
+struct Document
+{
+    //! input file name
+    std::string filename;
+
+    //! processed lines
+    TextLines lines;
+
+    //! log output of the session
+    std::string log;
+
+    //! error message if processing failed
+    std::string error;
+
+    //! directive records of the session, NULL unless profiling
+    std::unique_ptr<Profile> profile;
+
+    //! set when the session has finished
+    bool done;
+
+    Document() : done(false) { }
+};
+
+//! Processes documents on worker threads. Each document runs in its own
+//! session with a separate database connection, log and profile, such that
+//! the results can be written and reported in command line order.
+class DocumentJobs
+{
+protected:
+    //! documents in command line order
+    std::vector<Document> m_docs;
+
+    //! database connection of each session
+    std::string m_conninfo;
+
+    //! record a profile in each session
+    bool m_profile;
+
+    //! worker threads
+    std::vector<std::thread> m_threads;
+
+    //! lock protecting all following fields
+    std::mutex m_mutex;
+
+    //! signaled when a document is done
+    std::condition_variable m_cv_done;
+
+    //! index of next document to pick up
+    size_t m_next;
+
+    //! set to stop picking up documents
+    bool m_quit;
+
+    //! process one document in a new session
+    void process(Document& doc);
+
+    //! thread function: process documents until none are left
+    void worker();
+
+public:
+    DocumentJobs(int count, char** files, const std::string& conninfo)
+        : m_docs(count), m_conninfo(conninfo), m_profile(g_profile != NULL),
+          m_next(0), m_quit(false)
+    {
+        for (int i = 0; i < count; ++i)
+            m_docs[i].filename = files[i];
+    }
+
+    //! let workers finish their current documents and join them
+    ~DocumentJobs();
+
+    //! start jobs worker threads
+    void start(unsigned int jobs);
+
+    //! wait until document i is done and return it
+    Document& wait(size_t i);
+};
+
+//! process one document in a new session
+void DocumentJobs::process(Document& doc)
+{
+    std::ostringstream log;
+    g_log = &log;
+
+    if (m_profile) {
+        doc.profile.reset(new Profile);
+        g_profile = doc.profile.get();
+        g_profile->set_file(doc.filename);
+    }
+
+    try {
+        if (!g_db_connect(m_conninfo))
+            OUT_THROW("Fatal: could not connect to a SQL database");
+
+        std::ifstream in(doc.filename.c_str());
+        if (!in.good())
+            OUT_THROW("Error reading " << doc.filename << ": " << strerror(errno));
+
+        doc.lines = sp_process_stream(doc.filename, in);
+    }
+    catch (std::exception& e) {
+        doc.error = e.what();
+    }
+
+    g_db_free();
+
+    g_profile = NULL;
+    g_log = NULL;
+
+    doc.log = log.str();
+}
+
+//! thread function: process documents until none are left
+void DocumentJobs::worker()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_quit && m_next < m_docs.size())
+    {
+        Document& doc = m_docs[m_next++];
+        lock.unlock();
+
+        process(doc);
+
+        lock.lock();
+        doc.done = true;
+        m_cv_done.notify_all();
+    }
+}
+
+//! let workers finish their current documents and join them
+DocumentJobs::~DocumentJobs()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+}
+
+//! start jobs worker threads
+void DocumentJobs::start(unsigned int jobs)
+{
+    for (size_t i = 0; i < jobs && i < m_docs.size(); ++i)
+        m_threads.push_back(std::thread(&DocumentJobs::worker, this));
+}
+
+//! wait until document i is done and return it
+Document& DocumentJobs::wait(size_t i)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_docs[i].done)
+        m_cv_done.wait(lock);
+
+    return m_docs[i];
+}
+
 //! define identifiers for command line arguments
 enum { OPT_HELP, OPT_VERBOSE, OPT_FILETYPE,
        OPT_OUTPUT, OPT_CHECK_OUTPUT, OPT_DATABASE, OPT_RANGE,
-       OPT_WORK_DIR };
+       OPT_WORK_DIR, OPT_PREFETCH, OPT_INDEX_ADVISOR, OPT_POOL, OPT_PROFILE,
+       OPT_JOBS, OPT_INCREMENTAL };
 
 //! define command line arguments
 static CSimpleOpt::SOption sopt_list[] = {
@@ -104,6 +288,12 @@ static CSimpleOpt::SOption sopt_list[] = {
     { OPT_DATABASE,     "-D", SO_REQ_SEP },
     { OPT_RANGE,        "-R", SO_REQ_SEP },
     { OPT_WORK_DIR,     "-W", SO_REQ_SEP },
+    { OPT_PREFETCH,     "-P", SO_NONE },
+    { OPT_INDEX_ADVISOR, "-I", SO_NONE },
+    { OPT_POOL,         "-Q", SO_REQ_SEP },
+    { OPT_PROFILE,      "--profile", SO_OPT },
+    { OPT_JOBS,         "-j", SO_REQ_SEP },
+    { OPT_INCREMENTAL,  "-i", SO_NONE },
     SO_END_OF_OPTIONS
 };
 
@@ -120,12 +310,33 @@ sp_process_usage(const std::string& progname)
         "  -o <file>  Output all processed files to this stream." << std::endl <<
         "  -C         Verify that -o output file matches processed data (for tests)." << std::endl <<
         "  -D <type>  Select SQL database type and file or database." << std::endl <<
+        "             SQLite takes URI-style options: sqlite:file.db?mode=ro&immutable=1" << std::endl <<
+        "             &mmap_size=N&cache_size=N&wal=1&temp_store=memory&threads=N" << std::endl <<
+        "             &busy_timeout=ms (default 60000)" << std::endl <<
         "  -R <name>  Process only named RANGE in files." << std::endl <<
-        "  -W <dir>   Change working directory at start-up." << std::endl);
+        "  -W <dir>   Change working directory at start-up." << std::endl <<
+        "  -P         Prefetch queries up to the next SQL, IMPORT-DATA or CONNECT" << std::endl <<
+        "             in one batch (uses pipeline mode on PostgreSQL)." << std::endl <<
+        "  -I         Create indexes for queries up to the next SQL, IMPORT-DATA or" << std::endl <<
+        "             CONNECT and report remaining full scans (SQLite only)." << std::endl <<
+        "  -Q <n>     Run queries up to the next SQL, IMPORT-DATA or CONNECT in" << std::endl <<
+        "             parallel on <n> additional read connections (at most 64)." << std::endl <<
+        "             Queries on temporary tables run on the main connection." << std::endl <<
+        "  -j <n>     Process <n> files in parallel, each in its own database" << std::endl <<
+        "             session. The log is printed per file in command line order." << std::endl <<
+        "             Requires a database file or a shared in-memory database." << std::endl <<
+        "  -i         Incremental: keep a state file <file>.sp-state next to each" << std::endl <<
+        "             LaTeX file and skip directives whose command, data and" << std::endl <<
+        "             output did not change since the last run." << std::endl <<
+        "  --profile[=<file>]" << std::endl <<
+        "             Report time, rows and bytes of each directive (to file)." << std::endl);
 
     return EXIT_FAILURE;
 }
 
+//! maximum number of additional read connections of -Q
+static const int max_pool_size = 64;
+
 //! process LaTeX or Gnuplot, main function
 static inline int
 sp_process(int argc, char* argv[])
@@ -139,6 +350,12 @@ sp_process(int argc, char* argv[])
     // working directory
     std::string opt_work_dir;
 
+    // write profile report to this file instead of stderr
+    std::string opt_profile_file;
+
+    // number of files processed in parallel
+    unsigned int opt_jobs = 1;
+
     //! parse command line parameters using SimpleOpt
     CSimpleOpt args(argc, argv, sopt_list);
 
@@ -181,7 +398,59 @@ sp_process(int argc, char* argv[])
         case OPT_WORK_DIR:
             opt_work_dir = args.OptionArg();
             break;
+
+        case OPT_PREFETCH:
+            gopt_prefetch = true;
+            break;
+
+        case OPT_INDEX_ADVISOR:
+            gopt_index_advisor = true;
+            break;
+
+        case OPT_POOL:
+        {
+            int size = 0;
+            if (!from_str(std::string(args.OptionArg()), size) || size < 1) {
+                OUT(argv[0] << ": invalid number of read connections '" << args.OptionArg() << "'");
+                return EXIT_FAILURE;
+            }
+            if (size > max_pool_size) {
+                OUT("Connection pool limited to " << max_pool_size << " read connections.");
+                size = max_pool_size;
+            }
+            gopt_pool_size = size;
+            break;
         }
+
+        case OPT_PROFILE:
+            if (!g_profile) g_profile = new Profile;
+            if (args.OptionArg()) opt_profile_file = args.OptionArg();
+            break;
+
+        case OPT_JOBS:
+        {
+            int jobs = 0;
+            if (!from_str(std::string(args.OptionArg()), jobs) || jobs < 1) {
+                OUT(argv[0] << ": invalid number of parallel files '" << args.OptionArg() << "'");
+                return EXIT_FAILURE;
+            }
+            opt_jobs = jobs;
+            break;
+        }
+
+        case OPT_INCREMENTAL:
+            gopt_incremental = true;
+            break;
+        }
+    }
+
+    // state files describe the input files as rewritten in place
+    if (gopt_incremental &&
+        (opt_outputfile.size() || gopt_ranges.size() || !args.FileCount()))
+    {
+        OUT("Incremental processing disabled: it requires rewriting all of "
+            "the input files in place.");
+        gopt_incremental = false;
     }
 
     if (!opt_work_dir.empty()) {
@@ -193,6 +462,14 @@ sp_process(int argc, char* argv[])
     if (!g_db_connect(opt_db_conninfo))
         OUT_THROW("Fatal: could not connect to a SQL database");
 
+    // each session of -j would get its own empty database
+    if (opt_jobs > 1 && sql_is_private_memory(opt_db_conninfo))
+    {
+        OUT("Parallel processing disabled: a private in-memory SQLite "
+            "database is not visible to other sessions.");
+        opt_jobs = 1;
+    }
+
     // open output file or string stream
     std::ostream* output = NULL;
     if (gopt_check_output)
@@ -215,7 +492,26 @@ sp_process(int argc, char* argv[])
     }
 
     // process file commandline arguments
-    if (args.FileCount())
+    if (args.FileCount() && opt_jobs > 1)
+    {
+        DocumentJobs jobs(args.FileCount(), args.Files(), opt_db_conninfo);
+        jobs.start(opt_jobs);
+
+        for (int fi = 0; fi < args.FileCount(); ++fi)
+        {
+            Document& doc = jobs.wait(fi);
+
+            OUTX(doc.log);
+            if (doc.profile) g_profile->append(*doc.profile);
+
+            if (doc.error.size())
+                throw std::runtime_error(doc.error);
+
+            sp_write_document(doc.filename, doc.lines, output);
+            doc.lines = TextLines();
+        }
+    }
+    else if (args.FileCount())
     {
         for (int fi = 0; fi < args.FileCount(); ++fi)
         {
@@ -226,29 +522,20 @@ sp_process(int argc, char* argv[])
                 OUT_THROW("Error reading " << filename << ": " << strerror(errno));
             }
             else {
+                if (g_profile) g_profile->set_file(filename);
+
                 TextLines out = sp_process_stream(filename, in);
+                in.close();
 
-                if (output)  {
-                    // write to common output
-                    out.write_stream(*output);
-                }
-                else {
-                    // overwrite input file
-                    in.close();
-                    std::ofstream outfile(filename);
-                    if (!outfile.good())
-                        OUT_THROW("Error writing " << filename << ": " << strerror(errno));
-
-                    out.write_stream(outfile);
-                    if (!outfile.good())
-                        OUT_THROW("Error writing " << filename << ": " << strerror(errno));
-                }
+                sp_write_document(filename, out, output);
             }
         }
     }
     else // no file arguments -> process stdin
     {
         OUT("Reading text from stdin ...");
+        if (g_profile) g_profile->set_file("stdin");
+
         TextLines out = sp_process_stream("stdin", std::cin);
 
         if (output)  {
@@ -287,6 +574,27 @@ sp_process(int argc, char* argv[])
             delete output;
     }
 
+    // write profile report
+    if (g_profile)
+    {
+        if (opt_profile_file.size())
+        {
+            std::ofstream pf(opt_profile_file.c_str());
+            if (!pf.good())
+                OUT_THROW("Error writing " << opt_profile_file << ": " << strerror(errno));
+
+            g_profile->write_report(pf);
+            OUT("Wrote profile to " << opt_profile_file);
+        }
+        else
+        {
+            g_profile->write_report(std::cerr);
+        }
+
+        delete g_profile;
+        g_profile = NULL;
+    }
+
     g_db_free();
 
     return EXIT_SUCCESS;
@@ -23,8 +23,13 @@
 
 #include "mysql.h"
 #include "common.h"
+#include "strtools.h"
+#include "profile.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <vector>
@@ -34,46 +39,140 @@ struct MySqlBind : public MYSQL_BIND
 {
 };
 
+//! Number of rows transferred per round trip for cursor fetches
+static const unsigned long s_prefetch_rows = 1024;
+
+//! Format a double like the MySQL server does in its text protocol: using the
+//! shortest representation which parses back to the same value.
+static inline std::string format_double(double v)
+{
+    char buf[32];
+    for (int prec = 15; prec <= 17; ++prec) {
+        snprintf(buf, sizeof(buf), "%.*g", prec, v);
+        if (strtod(buf, NULL) == v) break;
+    }
+
+    // MySQL writes exponents without '+' sign and leading zeros: 1e20, 1e-5
+    std::string str = buf;
+    std::string::size_type epos = str.find('e');
+    if (epos != std::string::npos)
+    {
+        std::string::size_type dpos = epos + 1;
+        if (str[dpos] == '+')
+            str.erase(dpos, 1);
+        else if (str[dpos] == '-')
+            ++dpos;
+        while (dpos + 1 < str.size() && str[dpos] == '0')
+            str.erase(dpos, 1);
+    }
+    return str;
+}
+
 //! Class for result value
 struct MySqlColumn
 {
     //! NULL value indicator
     #if defined(LIBMYSQL_VERSION_ID) && LIBMYSQL_VERSION_ID >= 80000
     bool is_null;
+    bool error;
     #else
     my_bool is_null;
+    my_bool error;
     #endif
 
-    //! output string data, currently extra long strings are truncated.
-    char strdata[128];
+    //! type the column is bound as
+    enum_field_types type;
+
+    //! whether an integer column is unsigned
+    bool is_unsigned;
+
+    //! output integer or double data
+    union {
+        long long ival;
+        double dval;
+    };
+
+    //! output string data, sized from result metadata
+    std::vector<char> strdata;
 
     //! output string data length
     unsigned long length;
 
-    //! initialize internal bind pointers
-    void initialize_as_string(MySqlBind& bind)
+    //! initialize internal bind pointers matching the result field type
+    void initialize(MySqlBind& bind, const MYSQL_FIELD& field)
     {
-        // buffer
-        bind.buffer_type = MYSQL_TYPE_STRING;
-        bind.buffer = strdata;
-        bind.buffer_length = sizeof(strdata);
+        memset(&bind, 0, sizeof(bind));
+
+        switch (field.type)
+        {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+        case MYSQL_TYPE_YEAR:
+            type = MYSQL_TYPE_LONGLONG;
+            is_unsigned = (field.flags & UNSIGNED_FLAG) != 0;
+            bind.buffer = &ival;
+            bind.buffer_length = sizeof(ival);
+            bind.is_unsigned = is_unsigned;
+            break;
+
+        case MYSQL_TYPE_DOUBLE:
+            type = MYSQL_TYPE_DOUBLE;
+            bind.buffer = &dval;
+            bind.buffer_length = sizeof(dval);
+            break;
+
+        default:
+            // DECIMAL, FLOAT, dates and strings are transferred as text to
+            // keep their exact server-side formatting.
+            type = MYSQL_TYPE_STRING;
+            strdata.resize(std::max<unsigned long>(field.max_length, 1) + 1);
+            bind.buffer = strdata.data();
+            bind.buffer_length = strdata.size();
+            break;
+        }
+
+        bind.buffer_type = type;
         // null
         bind.is_null = &is_null;
         // length
         bind.length = &length;
+        // truncation flag
+        bind.error = &error;
+    }
+
+    //! return text representation of the value
+    std::string text() const
+    {
+        if (type == MYSQL_TYPE_LONGLONG)
+        {
+            if (is_unsigned)
+                return to_str(static_cast<unsigned long long>(ival));
+            return to_str(ival);
+        }
+        if (type == MYSQL_TYPE_DOUBLE)
+            return format_double(dval);
+
+        return std::string(strdata.data(), length);
     }
 };
 
 //! Execute a SQL query without parameters, throws on errors.
 MySqlQuery::MySqlQuery(class MySqlDatabase& db, const std::string& query)
     : SqlQueryImpl(query),
-      m_db(db), m_bind(NULL), m_result(NULL)
+      m_db(db), m_bind(NULL), m_result(NULL), m_meta(NULL)
 {
     // allocate prepared statement object
     m_stmt = mysql_stmt_init(m_db.m_db);
 
     // prepare statement
-    int rc = mysql_stmt_prepare(m_stmt, query.data(), query.size());
+    int rc;
+    {
+        ProfileTimer timer(Profile::PREPARE);
+        rc = mysql_stmt_prepare(m_stmt, query.data(), query.size());
+    }
 
     if (rc != 0)
     {
@@ -88,13 +187,17 @@ MySqlQuery::MySqlQuery(class MySqlDatabase& db, const std::string& query)
 MySqlQuery::MySqlQuery(class MySqlDatabase& db, const std::string& query,
                        const std::vector<std::string>& params)
     : SqlQueryImpl(query),
-      m_db(db), m_bind(NULL), m_result(NULL)
+      m_db(db), m_bind(NULL), m_result(NULL), m_meta(NULL)
 {
     // allocate prepared statement object
     m_stmt = mysql_stmt_init(m_db.m_db);
 
     // prepare statement
-    int rc = mysql_stmt_prepare(m_stmt, query.data(), query.size());
+    int rc;
+    {
+        ProfileTimer timer(Profile::PREPARE);
+        rc = mysql_stmt_prepare(m_stmt, query.data(), query.size());
+    }
 
     if (rc != 0)
     {
@@ -129,6 +232,10 @@ MySqlQuery::MySqlQuery(class MySqlDatabase& db, const std::string& query,
 //! Free result
 MySqlQuery::~MySqlQuery()
 {
+    if (m_meta)
+        mysql_free_result(m_meta);
+
+    mysql_stmt_free_result(m_stmt);
     mysql_stmt_close(m_stmt);
 
     if (m_bind)
@@ -141,7 +248,23 @@ MySqlQuery::~MySqlQuery()
 //! Bind output results and execute query
 void MySqlQuery::execute()
 {
-    int rc = mysql_stmt_execute(m_stmt);
+    // calculate max_length of result fields in mysql_stmt_store_result(), used
+    // to size the string bind buffers.
+    #if defined(LIBMYSQL_VERSION_ID) && LIBMYSQL_VERSION_ID >= 80000
+    bool update_max_length = true;
+    #else
+    my_bool update_max_length = 1;
+    #endif
+    mysql_stmt_attr_set(m_stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length);
+
+    // transfer rows in large batches if the server ever opens a cursor
+    mysql_stmt_attr_set(m_stmt, STMT_ATTR_PREFETCH_ROWS, &s_prefetch_rows);
+
+    int rc;
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        rc = mysql_stmt_execute(m_stmt);
+    }
 
     if (rc != 0)
     {
@@ -149,25 +272,80 @@ void MySqlQuery::execute()
                   "Failed : " << mysql_stmt_error(m_stmt));
     }
 
+    m_row = -1;
+
+    // statements without result set (INSERT, CREATE, etc) are done.
+    int cols = num_cols();
+    if (cols == 0) return;
+
+    // buffer complete result set on the client in one transfer, instead of
+    // fetching each row from the server.
+    {
+        ProfileTimer timer(Profile::FETCH);
+        rc = mysql_stmt_store_result(m_stmt);
+    }
+
+    if (rc != 0)
+    {
+        OUT_THROW("SQL store result \"" << query() << "\"\n" <<
+                  "Failed : " << mysql_stmt_error(m_stmt));
+    }
+
+    m_meta = mysql_stmt_result_metadata(m_stmt);
+
+    if (!m_meta)
+    {
+        OUT_THROW("SQL result metadata \"" << query() << "\"\n" <<
+                  "Failed : " << mysql_stmt_error(m_stmt));
+    }
+
     //! Bind all result columns, mysql apparently cannot fetch single column
     //! data, mysql_stmt_fetch_column() segfaults without
     //! mysql_stmt_bind_result().
-    int cols = num_cols();
-
     m_bind = new MySqlBind[cols];
-    memset(m_bind, 0, cols * sizeof(MySqlBind));
-
     m_result = new MySqlColumn[cols];
-    memset(m_result, 0, cols * sizeof(MySqlColumn));
 
     for (int c = 0; c < cols; ++c)
     {
-        m_result[c].initialize_as_string(m_bind[c]);
+        m_result[c].initialize(m_bind[c], *mysql_fetch_field_direct(m_meta, c));
     }
 
-    mysql_stmt_bind_result(m_stmt, m_bind);
+    if (mysql_stmt_bind_result(m_stmt, m_bind) != 0)
+    {
+        OUT_THROW("SQL bind result \"" << query() << "\"\n" <<
+                  "Failed : " << mysql_stmt_error(m_stmt));
+    }
+}
 
-    m_row = -1;
+//! Refetch columns truncated by the last mysql_stmt_fetch()
+void MySqlQuery::fetch_truncated()
+{
+    bool enlarged = false;
+
+    for (unsigned int c = 0; c < num_cols(); ++c)
+    {
+        MySqlColumn& col = m_result[c];
+        if (!col.error || col.type != MYSQL_TYPE_STRING) continue;
+
+        // enlarge buffer and fetch the column again
+        col.strdata.resize(col.length + 1);
+        m_bind[c].buffer = col.strdata.data();
+        m_bind[c].buffer_length = col.strdata.size();
+        enlarged = true;
+
+        if (mysql_stmt_fetch_column(m_stmt, &m_bind[c], c, 0) != 0)
+        {
+            OUT_THROW("SQL fetch column \"" << query() << "\"\n" <<
+                      "Failed : " << mysql_stmt_error(m_stmt));
+        }
+    }
+
+    // rebind to use the enlarged buffers for following rows
+    if (enlarged && mysql_stmt_bind_result(m_stmt, m_bind) != 0)
+    {
+        OUT_THROW("SQL bind result \"" << query() << "\"\n" <<
+                  "Failed : " << mysql_stmt_error(m_stmt));
+    }
 }
 
 //! Return number of rows in result, throws if no tuples.
@@ -176,22 +354,15 @@ unsigned int MySqlQuery::num_rows() const
     if (SqlDataCache::is_complete())
         return SqlDataCache::num_rows();
 
-    assert(!"Row number not available without cached result.");
-    return -1;
+    // the result set is stored on the client, so the row count is known.
+    return mysql_stmt_num_rows(m_stmt);
 }
 
 //! Return column name of col
 std::string MySqlQuery::col_name(unsigned int col) const
 {
-    MYSQL_RES* res = mysql_stmt_result_metadata(m_stmt);
-
-    MYSQL_FIELD *field = mysql_fetch_field_direct(res, col);
-
-    std::string name = field->name;
-
-    mysql_free_result(res);
-
-    return name;
+    assert(m_meta && col < num_cols());
+    return mysql_fetch_field_direct(m_meta, col)->name;
 }
 
 //! Return number of columns in result, throws if no tuples.
@@ -205,17 +376,8 @@ void MySqlQuery::read_colmap()
 {
     m_colmap.clear();
 
-    MYSQL_RES* res = mysql_stmt_result_metadata(m_stmt);
-
-    MYSQL_FIELD *field;
-    unsigned int col = 0;
-
-    while ( (field = mysql_fetch_field(res)) )
-    {
-        m_colmap[ field->name ] = col++;
-    }
-
-    mysql_free_result(res);
+    for (unsigned int col = 0; col < num_cols(); ++col)
+        m_colmap[ col_name(col) ] = col;
 }
 
 //! Return the current row number
@@ -227,8 +389,31 @@ unsigned int MySqlQuery::current_row() const
 //! Advance current result row to next (or first if uninitialized)
 bool MySqlQuery::step()
 {
+    if (num_cols() == 0) return false;
+
+    ProfileTimer timer(Profile::FETCH);
+
     ++m_row;
-    return (mysql_stmt_fetch(m_stmt) == 0);
+    int rc = mysql_stmt_fetch(m_stmt);
+
+    if (rc == MYSQL_NO_DATA)
+        return false;
+
+    if (Profile::Record* r = profile_record())
+        r->rows++;
+
+    if (rc == 0)
+        return true;
+    else if (rc == MYSQL_DATA_TRUNCATED)
+    {
+        fetch_truncated();
+        return true;
+    }
+    else
+    {
+        OUT_THROW("SQL query " << query() << "\n" <<
+                  "Step failed : " << mysql_stmt_error(m_stmt));
+    }
 }
 
 //! Returns true if cell (row,col) is NULL.
@@ -242,7 +427,7 @@ bool MySqlQuery::isNULL(unsigned int col) const
 std::string MySqlQuery::text(unsigned int col) const
 {
     assert(col < num_cols());
-    return std::string(m_result[col].strdata, m_result[col].length);
+    return m_result[col].text();
 }
 
 //! read complete result into memory
@@ -316,7 +501,11 @@ std::string MySqlDatabase::quote_field(const std::string& field) const
 bool MySqlDatabase::execute(const std::string& query)
 {
     // prepare statement
-    int rc = mysql_real_query(m_db, query.data(), query.size());
+    int rc;
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        rc = mysql_real_query(m_db, query.data(), query.size());
+    }
 
     if (rc != 0)
     {
@@ -330,6 +519,10 @@ bool MySqlDatabase::execute(const std::string& query)
 //! construct query object for given string
 SqlQuery MySqlDatabase::query(const std::string& query)
 {
+    // claim result if the query was run on a pool connection
+    SqlQuery provided = claim_result(query);
+    if (provided) return provided;
+
     return SqlQuery( new MySqlQuery(*this, query) );
 }
 
@@ -340,6 +533,14 @@ SqlQuery MySqlDatabase::query(const std::string& query,
     return SqlQuery( new MySqlQuery(*this, query, params) );
 }
 
+//! update planner statistics of a table after importing data
+void MySqlDatabase::analyze(const std::string& table)
+{
+    // ANALYZE TABLE returns a status result set, which must be read.
+    SqlQuery sql = query("ANALYZE TABLE " + quote_field(table));
+    while (sql->step()) { }
+}
+
 //! test if a table exists in the database
 bool MySqlDatabase::exist_table(const std::string&)
 {
@@ -48,9 +48,15 @@ protected:
     //! Opaque structure used to retrieve results
     struct MySqlColumn* m_result;
 
+    //! Result set metadata (column names and types)
+    MYSQL_RES* m_meta;
+
     //! Bind output results and execute query
     void execute();
 
+    //! Refetch columns truncated by the last mysql_stmt_fetch()
+    void fetch_truncated();
+
 public:
 
     //! Execute a SQL query without placeholders, throws on errors.
@@ -139,6 +145,9 @@ public:
     virtual SqlQuery query(const std::string& query,
                            const std::vector<std::string>& params);
 
+    //! update planner statistics of a table after importing data
+    virtual void analyze(const std::string& table);
+
     //! test if a table exists in the database
     virtual bool exist_table(const std::string& table);
 
@@ -24,6 +24,7 @@
 #include "pgsql.h"
 #include "common.h"
 #include "strtools.h"
+#include "profile.h"
 
 #include <cassert>
 #include <cstring>
@@ -35,7 +36,10 @@ PgSqlQuery::PgSqlQuery(class PgSqlDatabase& db, const std::string& query)
     : SqlQueryImpl(query),
       m_db(db)
 {
-    m_res = PQexec(m_db.m_pg, query.c_str());
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        m_res = PQexec(m_db.m_pg, query.c_str());
+    }
 
     ExecStatusType r = PQresultStatus(m_res);
 
@@ -64,8 +68,11 @@ PgSqlQuery::PgSqlQuery(class PgSqlDatabase& db, const std::string& query,
 
     // execute query with string variables
 
-    m_res = PQexecParams(m_db.m_pg, query.c_str(),
-                         params.size(), NULL, paramsC.data(), NULL, NULL, 0);
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        m_res = PQexecParams(m_db.m_pg, query.c_str(), params.size(),
+                             NULL, paramsC.data(), NULL, NULL, 0);
+    }
 
     ExecStatusType r = PQresultStatus(m_res);
 
@@ -80,6 +87,15 @@ PgSqlQuery::PgSqlQuery(class PgSqlDatabase& db, const std::string& query,
     m_row = -1;
 }
 
+//! Take ownership of an already received (prefetched) result.
+PgSqlQuery::PgSqlQuery(class PgSqlDatabase& db, const std::string& query,
+                       PGresult* res)
+    : SqlQueryImpl(query),
+      m_db(db), m_res(res)
+{
+    m_row = -1;
+}
+
 //! Free result
 PgSqlQuery::~PgSqlQuery()
 {
@@ -142,7 +158,12 @@ unsigned int PgSqlQuery::current_row() const
 bool PgSqlQuery::step()
 {
     ++m_row;
-    return (m_row < num_rows());
+    if (m_row >= num_rows()) return false;
+
+    if (Profile::Record* r = profile_record())
+        r->rows++;
+
+    return true;
 }
 
 //! Returns true if cell (row,col) is NULL.
@@ -209,6 +230,7 @@ bool PgSqlDatabase::initialize(const std::string& params)
 //! destructor to free connection
 PgSqlDatabase::~PgSqlDatabase()
 {
+    clear_prefetched();
     PQfinish(m_pg);
 }
 
@@ -233,7 +255,14 @@ std::string PgSqlDatabase::quote_field(const std::string& field) const
 //! execute SQL query without result
 bool PgSqlDatabase::execute(const std::string& query)
 {
-    PGresult* res = PQexec(m_pg, query.c_str());
+    // results fetched before may be outdated by this command
+    clear_prefetched();
+
+    PGresult* res;
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        res = PQexec(m_pg, query.c_str());
+    }
 
     ExecStatusType r = PQresultStatus(res);
 
@@ -257,6 +286,19 @@ bool PgSqlDatabase::execute(const std::string& query)
 //! construct query object for given string
 SqlQuery PgSqlDatabase::query(const std::string& query)
 {
+    // claim result if the query was run on a pool connection
+    SqlQuery provided = claim_result(query);
+    if (provided) return provided;
+
+    // claim result if the query was prefetched
+    prefetched_type::iterator it = m_prefetched.find(query);
+    if (it != m_prefetched.end())
+    {
+        PGresult* res = it->second;
+        m_prefetched.erase(it);
+        return SqlQuery( new PgSqlQuery(*this, query, res) );
+    }
+
     return SqlQuery( new PgSqlQuery(*this, query) );
 }
 
@@ -267,6 +309,114 @@ SqlQuery PgSqlDatabase::query(const std::string& query,
     return SqlQuery( new PgSqlQuery(*this, query, params) );
 }
 
+//! free all unclaimed prefetched results
+void PgSqlDatabase::clear_prefetched()
+{
+    for (prefetched_type::iterator it = m_prefetched.begin();
+         it != m_prefetched.end(); ++it)
+    {
+        PQclear(it->second);
+    }
+    m_prefetched.clear();
+}
+
+//! submit a batch of independent read-only queries in pipeline mode
+void PgSqlDatabase::prefetch(const std::vector<std::string>& queries)
+{
+    // unclaimed results of an earlier batch may be outdated
+    clear_prefetched();
+
+#if LIBPQ_HAS_PIPELINING
+    if (queries.empty()) return;
+
+    ProfileTimer timer(Profile::EXECUTE);
+
+    if (PQenterPipelineMode(m_pg) != 1)
+    {
+        OUT("PostgreSQL pipeline mode not available: " << errmsg());
+        return;
+    }
+
+    // Queries are sent in small batches before reading the results, such that
+    // the query stream always fits into the socket buffers and the server
+    // never blocks on us while we are still sending.
+    static const size_t batch_bytes = 16 * 1024;
+
+    size_t qi = 0, prefetched = 0;
+    bool failed = false, synced = true;
+
+    while (qi < queries.size() && !failed)
+    {
+        size_t qbegin = qi, bytes = 0;
+
+        while (qi < queries.size() && bytes < batch_bytes)
+        {
+            if (PQsendQueryParams(m_pg, queries[qi].c_str(), 0,
+                                  NULL, NULL, NULL, NULL, 0) != 1)
+            {
+                OUT("PostgreSQL pipeline send failed: " << errmsg());
+                failed = true;
+                break;
+            }
+            bytes += queries[qi++].size();
+
+            // a sync point after each query isolates errors to that query
+            if (PQpipelineSync(m_pg) != 1)
+            {
+                OUT("PostgreSQL pipeline send failed: " << errmsg());
+                failed = true;
+                synced = false;
+                break;
+            }
+        }
+
+        // receive results of all sent queries: query result, NULL, then the
+        // sync result, which is missing if sending it failed.
+        for (size_t i = qbegin; i < qi; ++i)
+        {
+            PGresult* res;
+            while ((res = PQgetResult(m_pg)) != NULL)
+            {
+                ExecStatusType r = PQresultStatus(res);
+
+                if (r == PGRES_TUPLES_OK || r == PGRES_COMMAND_OK) {
+                    m_prefetched.insert(std::make_pair(queries[i], res));
+                    ++prefetched;
+                }
+                else {
+                    // failed queries are executed again by query(), which
+                    // reports the error.
+                    PQclear(res);
+                }
+            }
+
+            if (!synced && i + 1 == qi) break;
+
+            // skip any pending results up to PGRES_PIPELINE_SYNC
+            while ((res = PQgetResult(m_pg)) != NULL)
+            {
+                bool sync = (PQresultStatus(res) == PGRES_PIPELINE_SYNC);
+                PQclear(res);
+                if (sync) break;
+            }
+        }
+    }
+
+    if (PQexitPipelineMode(m_pg) != 1)
+    {
+        // a connection left in pipeline mode fails all later queries
+        OUT("PostgreSQL pipeline exit failed: " << errmsg() <<
+            ", resetting connection.");
+        PQreset(m_pg);
+    }
+
+    OUT("Prefetched " << prefetched << " of " << queries.size() <<
+        " queries in pipeline mode.");
+#else
+    (void)queries;
+#endif
+}
+
 //! test if a table exists in the database
 bool PgSqlDatabase::exist_table(const std::string& table)
 {
@@ -283,6 +433,38 @@ bool PgSqlDatabase::exist_table(const std::string& table)
     return (sql.text(0) != "0");
 }
 
+//! test if a table, view or other named object exists, including temporary
+//! ones, ignoring case.
+bool PgSqlDatabase::exist_object(const std::string& name)
+{
+    std::vector<std::string> params;
+    params.push_back(name);
+
+    PgSqlQuery sql(*this,
+                   "SELECT COUNT(*) FROM pg_class WHERE lower(relname) = lower($1)",
+                   params);
+
+    assert(sql.num_rows() == 1 && sql.num_cols() == 1);
+    sql.step();
+
+    return (sql.text(0) != "0");
+}
+
+//! return lower-case names of the tables and views in the temporary schema of
+//! this session
+std::set<std::string> PgSqlDatabase::temp_objects()
+{
+    PgSqlQuery sql(*this,
+                   "SELECT lower(relname) FROM pg_class "
+                   "WHERE relnamespace = pg_my_temp_schema()");
+
+    std::set<std::string> names;
+    while (sql.step())
+        names.insert(sql.text(0));
+
+    return names;
+}
+
 //! return last error message string
 const char* PgSqlDatabase::errmsg() const
 {
@@ -30,6 +30,8 @@
 
 #include "sql.h"
 
+#include <map>
+
 class PgSqlQuery : public SqlQueryImpl
 {
 protected:
@@ -51,6 +53,10 @@ public:
     PgSqlQuery(class PgSqlDatabase& db, const std::string& query,
                const std::vector<std::string>& params);
 
+    //! Take ownership of an already received (prefetched) result.
+    PgSqlQuery(class PgSqlDatabase& db, const std::string& query,
+               PGresult* res);
+
     //! Free result
     ~PgSqlQuery();
 
@@ -98,6 +104,15 @@ protected:
     //! database connection
     PGconn* m_pg;
 
+    //! type of m_prefetched
+    typedef std::multimap<std::string, PGresult*> prefetched_type;
+
+    //! results of prefetched queries not yet claimed by query()
+    prefetched_type m_prefetched;
+
+    //! free all unclaimed prefetched results
+    void clear_prefetched();
+
     //! for access to database connection
     friend class PgSqlQuery;
 
@@ -127,9 +142,20 @@ public:
     virtual SqlQuery query(const std::string& query,
                            const std::vector<std::string>& params);
 
+    //! submit a batch of independent read-only queries in pipeline mode
+    virtual void prefetch(const std::vector<std::string>& queries);
+
     //! test if a table exists in the database
     virtual bool exist_table(const std::string& table);
 
+    //! test if a table, view or other named object exists, including
+    //! temporary ones, ignoring case.
+    virtual bool exist_object(const std::string& name);
+
+    //! return lower-case names of the tables and views in the temporary
+    //! schema of this session
+    virtual std::set<std::string> temp_objects();
+
     //! return last error message string
     virtual const char* errmsg() const;
 };
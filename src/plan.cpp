@@ -0,0 +1,296 @@
+/******************************************************************************
+ * src/plan.cpp
+ *
+ * Plan of read-only directive queries which may run ahead of the SQL,
+ * IMPORT-DATA and CONNECT directives preceding them.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "plan.h"
+#include "common.h"
+#include "textlines.h"
+#include "strtools.h"
+#include "sqlpool.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/regex.hpp>
+
+//! test for a character of an unquoted identifier
+static inline bool
+is_ident_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '$';
+}
+
+//! return the lower-case name of a possibly quoted and qualified table
+//! identifier, or an empty string if it cannot be determined safely.
+static inline std::string
+table_name(const std::string& ident)
+{
+    std::vector<std::string> parts = split(ident, '.');
+    if (parts.size() > 2) return std::string();
+
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        std::string& p = parts[i];
+
+        // remove quotes, quoted names must not contain special characters
+        if (p.size() >= 2 &&
+            ((p[0] == '"' && p[p.size() - 1] == '"') ||
+             (p[0] == '`' && p[p.size() - 1] == '`') ||
+             (p[0] == '[' && p[p.size() - 1] == ']')))
+        {
+            p = p.substr(1, p.size() - 2);
+        }
+
+        if (p.empty()) return std::string();
+
+        for (size_t j = 0; j < p.size(); ++j) {
+            if (!is_ident_char(p[j])) return std::string();
+        }
+
+        p = str_tolower(p);
+    }
+
+    // tables of other attached databases or schemas are not checked
+    if (parts.size() == 2 && parts[0] != "main" && parts[0] != "temp")
+        return std::string();
+
+    return parts.back();
+}
+
+//! test whether the query mentions any of the lower-case names as an
+//! identifier
+bool mentions_any(const std::string& query, const std::set<std::string>& names)
+{
+    if (names.empty()) return false;
+
+    for (size_t i = 0; i < query.size(); )
+    {
+        if (!is_ident_char(query[i])) {
+            ++i;
+            continue;
+        }
+
+        size_t j = i;
+        while (j < query.size() && is_ident_char(query[j])) ++j;
+
+        if (names.count(str_tolower(query.substr(i, j - i))))
+            return true;
+
+        i = j;
+    }
+
+    return false;
+}
+
+//! record that a passed barrier writes table, returns false if this may
+//! change the result of any query
+bool DirectivePlan::write_table(const std::string& table)
+{
+    std::string name = table_name(table);
+    if (name.empty()) return false;
+
+    // a table which existed before may be read through views
+    if (!m_written.count(name) && g_db->exist_object(name))
+        return false;
+
+    m_written.insert(name);
+    return true;
+}
+
+//! try to pass a SQL, IMPORT-DATA or CONNECT directive, returns false if
+//! following queries may depend on it and the plan ends.
+bool DirectivePlan::pass_barrier(const std::string& first_word,
+                                 const std::string& cmd)
+{
+    bool pass = false;
+
+    if (first_word == "SQL")
+    {
+        static const boost::regex re_create(
+            "\\A\\s*CREATE\\s+(?:TEMP\\s+|TEMPORARY\\s+)?(?:TABLE|VIEW)\\s+"
+            "(?:IF\\s+NOT\\s+EXISTS\\s+)?([^\\s(]+)", boost::regex::icase);
+        static const boost::regex re_write(
+            "\\A\\s*(?:INSERT(?:\\s+OR\\s+\\w+)?\\s+INTO|REPLACE\\s+INTO|"
+            "UPDATE(?:\\s+OR\\s+\\w+)?|DELETE\\s+FROM)\\s+([^\\s(]+)",
+            boost::regex::icase);
+        static const boost::regex re_index(
+            "\\A\\s*CREATE\\s+(?:UNIQUE\\s+)?INDEX\\s", boost::regex::icase);
+
+        std::string sql = cmd.substr(first_word.size());
+        boost::smatch rm;
+
+        // only single statements are analyzed
+        std::string::size_type semicolon = sql.find(';');
+        if (semicolon != std::string::npos &&
+            sql.find_first_not_of(" \t\r\n", semicolon + 1) != std::string::npos)
+        {
+            pass = false;
+        }
+        else if (boost::regex_search(sql, rm, re_create) ||
+                 boost::regex_search(sql, rm, re_write))
+        {
+            pass = write_table(rm[1]);
+        }
+        else if (boost::regex_search(sql, re_index))
+        {
+            // indexes do not change query results
+            pass = true;
+        }
+    }
+    else if (first_word == "IMPORT-DATA")
+    {
+        std::vector<std::string> args = split_ws(cmd);
+
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            // importing into another database is not checked
+            if (args[i] == "-D") break;
+            if (args[i][0] == '-') continue;
+
+            pass = write_table(args[i]);
+            break;
+        }
+    }
+
+    if (pass) ++m_barriers;
+    return pass;
+}
+
+//! add the query of a read-only directive, unless it mentions a table written
+//! by a passed barrier or its result was already provided to the database
+//! connection by an earlier plan.
+void DirectivePlan::add_query(const std::string& query)
+{
+    if (mentions_any(query, m_written)) return;
+
+    size_t& provided = m_provided[query];
+    if (provided < g_db->count_results(query)) {
+        ++provided;
+        return;
+    }
+
+    m_queries.push_back(query);
+}
+
+template <char CommentChar>
+DocumentPlanner<CommentChar>::DocumentPlanner(
+    const TextLines& lines, directive_query_type directive_query)
+    : m_lines(lines), m_directive_query(directive_query),
+      m_barriers(0), m_plan_end(std::numeric_limits<size_t>::max())
+{
+}
+
+//! Plan queries of read-only directives from ln up to the next SQL,
+//! IMPORT-DATA or CONNECT directive which they may depend on.
+template <char CommentChar>
+void DocumentPlanner<CommentChar>::scan_queries(
+    size_t ln, bool active_range, DirectivePlan& plan)
+{
+    while (ln < m_lines.size())
+    {
+        std::string cmd;
+        size_t indent;
+
+        if (!m_lines.template collect_comment<CommentChar>(ln, cmd, indent))
+            continue;
+
+        std::string::size_type space_pos =
+            cmd.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZ-_");
+        std::string first_word = cmd.substr(0, space_pos);
+
+        if (first_word == "RANGE")
+        {
+            std::vector<std::string> words = split_ws(cmd, 3);
+            if (words.size() == 3 &&
+                std::find(gopt_ranges.begin(), gopt_ranges.end(),
+                          words[2]) != gopt_ranges.end())
+            {
+                if (words[1] == "BEGIN") active_range = true;
+                if (words[1] == "END") active_range = false;
+            }
+        }
+        else if (!active_range)
+        {
+            // skip keywords in non-active ranges
+        }
+        else if (first_word == "SQL" || first_word == "IMPORT-DATA" ||
+                 first_word == "CONNECT")
+        {
+            // following queries may depend on this command, unless it only
+            // writes new tables which they do not mention
+            if (!plan.pass_barrier(first_word, cmd)) break;
+        }
+        else
+        {
+            try {
+                std::string query = m_directive_query(first_word, cmd, space_pos);
+                if (query.size()) plan.add_query(query);
+            }
+            catch (std::runtime_error&) {
+                // parse errors are reported when processing the directive
+            }
+        }
+    }
+}
+
+//! Create indexes for, run in the connection pool and prefetch the queries of
+//! the following read-only directives, if enabled.
+template <char CommentChar>
+void DocumentPlanner<CommentChar>::prepare(size_t ln, bool active_range)
+{
+    if (!gopt_index_advisor && !gopt_prefetch && !g_pool) return;
+
+    // unclaimed results are outdated after a barrier their plan did not pass
+    if (m_barriers > m_plan_end) {
+        g_db->clear_results();
+        m_plan_end = std::numeric_limits<size_t>::max();
+    }
+
+    DirectivePlan plan;
+    scan_queries(ln, active_range, plan);
+
+    m_plan_end = std::min(m_plan_end, m_barriers + plan.barriers());
+
+    std::vector<std::string> queries = plan.queries();
+
+    if (gopt_index_advisor)
+    {
+        ProfileDirective profile(ln, "INDEX");
+        g_db->advise_indexes(queries);
+    }
+    if (g_pool)
+    {
+        ProfileDirective profile(ln, "POOL");
+        queries = g_pool->provide(*g_db, queries);
+    }
+    if (gopt_prefetch)
+    {
+        ProfileDirective profile(ln, "PREFETCH");
+        g_db->prefetch(queries);
+    }
+}
+
+// planners of LaTeX and Gnuplot documents
+template class DocumentPlanner<'%'>;
+template class DocumentPlanner<'#'>;
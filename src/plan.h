@@ -0,0 +1,139 @@
+/******************************************************************************
+ * src/plan.h
+ *
+ * Plan of read-only directive queries which may run ahead of the SQL,
+ * IMPORT-DATA and CONNECT directives preceding them.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef PLAN_HEADER
+#define PLAN_HEADER
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class TextLines;
+
+//! test whether the query mentions any of the lower-case names as an
+//! identifier
+bool mentions_any(const std::string& query, const std::set<std::string>& names);
+
+//! Collects the queries of read-only directives following a position in a
+//! document, which are run in advance by the connection pool or prefetching.
+//!
+//! The SQL, IMPORT-DATA and CONNECT directives are barriers. A barrier which
+//! only creates tables that did not exist when planning, or writes tables
+//! created by earlier barriers of the plan, cannot change the result of a
+//! query which does not mention these tables: any query reading them through
+//! a view would have failed and is run again in order. Such queries are
+//! planned ahead of the barrier, all others wait for a plan made after it.
+class DirectivePlan
+{
+protected:
+    //! lower-case names of tables written by passed barriers
+    std::set<std::string> m_written;
+
+    //! number of passed barriers
+    size_t m_barriers;
+
+    //! planned queries
+    std::vector<std::string> m_queries;
+
+    //! number of planned queries whose results are already provided
+    std::map<std::string, size_t> m_provided;
+
+    //! record that a passed barrier writes table, returns false if this may
+    //! change the result of any query
+    bool write_table(const std::string& table);
+
+public:
+    DirectivePlan()
+        : m_barriers(0)
+    { }
+
+    //! try to pass a SQL, IMPORT-DATA or CONNECT directive, returns false if
+    //! following queries may depend on it and the plan ends.
+    bool pass_barrier(const std::string& first_word, const std::string& cmd);
+
+    //! add the query of a read-only directive, unless it mentions a table
+    //! written by a passed barrier or its result was already provided to the
+    //! database connection by an earlier plan.
+    void add_query(const std::string& query);
+
+    //! number of passed barriers
+    size_t barriers() const
+    {
+        return m_barriers;
+    }
+
+    //! planned queries
+    const std::vector<std::string>& queries() const
+    {
+        return m_queries;
+    }
+};
+
+//! Plans the queries of a document segment by segment, shared by the LaTeX
+//! and Gnuplot processors. A segment starts at the beginning of the document
+//! and after each processed SQL, IMPORT-DATA or CONNECT directive.
+template <char CommentChar>
+class DocumentPlanner
+{
+public:
+    //! function returning the SQL query run by a read-only directive, or an
+    //! empty string for all other keywords.
+    typedef std::string (*directive_query_type)(
+        const std::string& first_word, const std::string& cmd,
+        std::string::size_type space_pos);
+
+protected:
+    //! processed line data
+    const TextLines& m_lines;
+
+    //! queries of read-only directives of the document type
+    directive_query_type m_directive_query;
+
+    //! number of SQL, IMPORT-DATA and CONNECT directives processed
+    size_t m_barriers;
+
+    //! number of barriers which unclaimed results of plans remain valid for
+    size_t m_plan_end;
+
+    //! Plan queries of read-only directives from ln up to the next SQL,
+    //! IMPORT-DATA or CONNECT directive which they may depend on.
+    void scan_queries(size_t ln, bool active_range, DirectivePlan& plan);
+
+public:
+    DocumentPlanner(const TextLines& lines, directive_query_type directive_query);
+
+    //! Create indexes for, run in the connection pool and prefetch the
+    //! queries of the following read-only directives, if enabled.
+    void prepare(size_t ln, bool active_range);
+
+    //! Count a processed SQL, IMPORT-DATA or CONNECT directive ending before
+    //! ln and prepare the following segment.
+    void barrier(size_t ln, bool active_range)
+    {
+        ++m_barriers;
+        prepare(ln, active_range);
+    }
+};
+
+#endif // PLAN_HEADER
@@ -0,0 +1,188 @@
+/******************************************************************************
+ * src/profile.cpp
+ *
+ * Collect per-directive timing profiles for --profile.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+#include <time.h>
+
+//! profile of the current thread's session, NULL unless --profile is given
+thread_local Profile* g_profile = NULL;
+
+//! set in connection pool threads, which do not record into the profile
+thread_local bool g_profile_worker = false;
+
+Profile::Profile()
+    : m_active(false), m_start(0)
+{
+}
+
+//! return monotonic timestamp in seconds
+double Profile::timestamp()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//! set file name for following directives
+void Profile::set_file(const std::string& file)
+{
+    m_file = file;
+}
+
+//! start record of a new directive
+void Profile::begin(size_t line, const std::string& kind)
+{
+    if (m_active) end();
+
+    m_current.file = m_file;
+    m_current.line = line;
+    m_current.kind = kind;
+    m_current.total = 0;
+    std::fill(m_current.phase, m_current.phase + NUM_PHASES, 0.0);
+    m_current.rows = m_current.bytes = 0;
+    std::fill(m_current.counter, m_current.counter + NUM_COUNTERS, 0);
+
+    m_active = true;
+    m_start = timestamp();
+}
+
+//! finish current directive record
+void Profile::end()
+{
+    if (!m_active) return;
+
+    m_current.total = timestamp() - m_start;
+
+    // format time is whatever the directive spent outside the measured phases
+    double measured = 0;
+    for (unsigned int p = 0; p < NUM_PHASES; ++p)
+        measured += m_current.phase[p];
+
+    m_current.phase[FORMAT] = std::max(0.0, m_current.total - measured);
+
+    m_records.push_back(m_current);
+    m_active = false;
+}
+
+//! append the finished records of another profile
+void Profile::append(const Profile& other)
+{
+    m_records.insert(m_records.end(),
+                     other.m_records.begin(), other.m_records.end());
+}
+
+//! order records by descending total time
+static inline bool
+record_total_greater(const Profile::Record* a, const Profile::Record* b)
+{
+    return a->total > b->total;
+}
+
+//! escape a value of a TAB-separated RESULT line, which has no quoting
+static inline std::string
+result_escape(const std::string& value)
+{
+    std::string out;
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        if (value[i] == '\\') out += "\\\\";
+        else if (value[i] == '\t') out += "\\t";
+        else if (value[i] == '\n') out += "\\n";
+        else if (value[i] == '\r') out += "\\r";
+        else out += value[i];
+    }
+    return out;
+}
+
+//! write text report sorted by total time and RESULT lines, which are split
+//! at TABs such that file names may contain spaces.
+void Profile::write_report(std::ostream& os) const
+{
+    static const char* phase_name[NUM_PHASES] = {
+        "prepare", "execute", "fetch", "format", "rewrite"
+    };
+    static const char* counter_name[NUM_COUNTERS] = {
+        "fullscan_step", "sort", "autoindex", "vm_step"
+    };
+
+    std::vector<const Record*> sorted(m_records.size());
+    for (size_t i = 0; i < m_records.size(); ++i)
+        sorted[i] = &m_records[i];
+
+    std::stable_sort(sorted.begin(), sorted.end(), record_total_greater);
+
+    double total = 0;
+    for (size_t i = 0; i < m_records.size(); ++i)
+        total += m_records[i].total;
+
+    // text report with times in milliseconds
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+
+    os << "Profile of " << m_records.size() << " directives, total "
+       << std::fixed << std::setprecision(3) << total * 1e3 << " ms:"
+       << std::endl;
+
+    os << std::setw(10) << "total";
+    for (unsigned int p = 0; p < NUM_PHASES; ++p)
+        os << std::setw(10) << phase_name[p];
+    os << std::setw(10) << "rows" << std::setw(10) << "bytes";
+    for (unsigned int c = 0; c < NUM_COUNTERS; ++c)
+        os << std::setw(14) << counter_name[c];
+    os << "  directive" << std::endl;
+
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const Record& r = *sorted[i];
+
+        os << std::setw(10) << r.total * 1e3;
+        for (unsigned int p = 0; p < NUM_PHASES; ++p)
+            os << std::setw(10) << r.phase[p] * 1e3;
+        os << std::setw(10) << r.rows << std::setw(10) << r.bytes;
+        for (unsigned int c = 0; c < NUM_COUNTERS; ++c)
+            os << std::setw(14) << r.counter[c];
+        os << "  " << r.file << ":" << r.line << " " << r.kind << std::endl;
+    }
+
+    os.flags(flags);
+    os.precision(precision);
+
+    // RESULT lines in file order, times in seconds
+    for (size_t i = 0; i < m_records.size(); ++i)
+    {
+        const Record& r = m_records[i];
+
+        os << "RESULT\tfile=" << result_escape(r.file) << "\tline=" << r.line
+           << "\tkind=" << r.kind << "\ttotal=" << r.total;
+        for (unsigned int p = 0; p < NUM_PHASES; ++p)
+            os << '\t' << phase_name[p] << '=' << r.phase[p];
+        os << "\trows=" << r.rows << "\tbytes=" << r.bytes;
+        for (unsigned int c = 0; c < NUM_COUNTERS; ++c)
+            os << '\t' << counter_name[c] << '=' << r.counter[c];
+        os << std::endl;
+    }
+}
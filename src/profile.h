@@ -0,0 +1,167 @@
+/******************************************************************************
+ * src/profile.h
+ *
+ * Collect per-directive timing profiles for --profile.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef PROFILE_HEADER
+#define PROFILE_HEADER
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//! Collects one timing record per processed directive.
+class Profile
+{
+public:
+    //! phases of a directive's wall time
+    enum phase_type {
+        PREPARE, EXECUTE, FETCH, FORMAT, REWRITE, NUM_PHASES
+    };
+
+    //! SQLite statement counters from sqlite3_stmt_status()
+    enum counter_type {
+        FULLSCAN_STEP, SORT, AUTOINDEX, VM_STEP, NUM_COUNTERS
+    };
+
+    //! timing record of one directive
+    struct Record
+    {
+        //! source file name
+        std::string file;
+
+        //! line number as shown in the processing log
+        size_t line;
+
+        //! directive keyword
+        std::string kind;
+
+        //! total wall time in seconds
+        double total;
+
+        //! wall time per phase in seconds, FORMAT is the remainder
+        double phase[NUM_PHASES];
+
+        //! number of result rows fetched
+        size_t rows;
+
+        //! number of bytes written into the document
+        size_t bytes;
+
+        //! summed SQLite statement counters
+        long counter[NUM_COUNTERS];
+    };
+
+protected:
+    //! finished records
+    std::vector<Record> m_records;
+
+    //! record of the directive in progress
+    Record m_current;
+
+    //! true while a directive is in progress
+    bool m_active;
+
+    //! timestamp at begin of current directive
+    double m_start;
+
+    //! current source file name
+    std::string m_file;
+
+public:
+    Profile();
+
+    //! return monotonic timestamp in seconds
+    static double timestamp();
+
+    //! set file name for following directives
+    void set_file(const std::string& file);
+
+    //! start record of a new directive
+    void begin(size_t line, const std::string& kind);
+
+    //! finish current directive record
+    void end();
+
+    //! return record in progress or NULL
+    Record* current()
+    {
+        return m_active ? &m_current : NULL;
+    }
+
+    //! append the finished records of another profile
+    void append(const Profile& other);
+
+    //! write text report sorted by total time and RESULT lines
+    void write_report(std::ostream& os) const;
+};
+
+//! profile of the current thread's session, NULL unless --profile is given
+extern thread_local Profile* g_profile;
+
+//! set in connection pool threads, which do not record into the profile
+extern thread_local bool g_profile_worker;
+
+//! return record of the directive in progress, or NULL if not profiling
+static inline Profile::Record* profile_record()
+{
+    return (g_profile && !g_profile_worker) ? g_profile->current() : NULL;
+}
+
+//! Adds the wall time of its scope to a phase of the current directive.
+class ProfileTimer
+{
+protected:
+    //! phase time to add to, or NULL
+    double* m_dest;
+
+    //! start timestamp
+    double m_start;
+
+public:
+    explicit ProfileTimer(Profile::phase_type phase)
+    {
+        Profile::Record* r = profile_record();
+        m_dest = r ? &r->phase[phase] : NULL;
+        m_start = m_dest ? Profile::timestamp() : 0;
+    }
+
+    ~ProfileTimer()
+    {
+        if (m_dest) *m_dest += Profile::timestamp() - m_start;
+    }
+};
+
+//! Records a directive for the lifetime of the object.
+class ProfileDirective
+{
+public:
+    ProfileDirective(size_t line, const std::string& kind)
+    {
+        if (g_profile) g_profile->begin(line, kind);
+    }
+
+    ~ProfileDirective()
+    {
+        if (g_profile) g_profile->end();
+    }
+};
+
+#endif // PROFILE_HEADER
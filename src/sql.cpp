@@ -24,7 +24,9 @@
 #include "sql.h"
 #include "common.h"
 #include "strtools.h"
+#include "profile.h"
 
+#include <cassert>
 #include <cstring>
 #include <iomanip>
 #include <sstream>
@@ -149,6 +151,157 @@ std::string SqlQueryImpl::format_texttable()
 
 ////////////////////////////////////////////////////////////////////////////////
 
+//! Read the complete result of a fresh query into memory.
+SqlMaterializedQuery::SqlMaterializedQuery(SqlQueryImpl& sql)
+    : SqlQueryImpl(sql.query()),
+      m_row(-1)
+{
+    for (unsigned int col = 0; col < sql.num_cols(); ++col)
+        m_colnames.push_back(sql.col_name(col));
+
+    SqlDataCache::read_complete(sql);
+}
+
+//! Return number of rows in result.
+unsigned int SqlMaterializedQuery::num_rows() const
+{
+    return SqlDataCache::num_rows();
+}
+
+//! Return number of columns in result.
+unsigned int SqlMaterializedQuery::num_cols() const
+{
+    return m_colnames.size();
+}
+
+//! Return column name of col
+std::string SqlMaterializedQuery::col_name(unsigned int col) const
+{
+    assert(col < num_cols());
+    return m_colnames[col];
+}
+
+//! Return the current row number
+unsigned int SqlMaterializedQuery::current_row() const
+{
+    return m_row;
+}
+
+//! Advance current result row to next (or first if uninitialized)
+bool SqlMaterializedQuery::step()
+{
+    if (m_row >= (int)num_rows())
+        return false;
+
+    if (++m_row >= (int)num_rows())
+        return false;
+
+    Profile::Record* pr = profile_record();
+    if (pr) pr->rows++;
+
+    return true;
+}
+
+//! Returns true if cell (current_row,col) is NULL.
+bool SqlMaterializedQuery::isNULL(unsigned int col) const
+{
+    return SqlDataCache::isNULL(m_row, col);
+}
+
+//! Return text representation of column col of current row.
+std::string SqlMaterializedQuery::text(unsigned int col) const
+{
+    return SqlDataCache::text(m_row, col);
+}
+
+//! read complete result into memory (which it already is)
+void SqlMaterializedQuery::read_complete()
+{
+}
+
+//! Returns true if cell (row,col) is NULL.
+bool SqlMaterializedQuery::isNULL(unsigned int row, unsigned int col) const
+{
+    return SqlDataCache::isNULL(row, col);
+}
+
+//! Return text representation of cell (row,col).
+std::string SqlMaterializedQuery::text(unsigned int row, unsigned int col) const
+{
+    return SqlDataCache::text(row, col);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 SqlDatabase::~SqlDatabase()
 {
 }
+
+//! claim a result handed over by provide_result(), or return NULL.
+SqlQuery SqlDatabase::claim_result(const std::string& query)
+{
+    provided_type::iterator it = m_provided.find(query);
+    if (it == m_provided.end()) return SqlQuery();
+
+    SqlQuery result = it->second;
+    m_provided.erase(it);
+    return result;
+}
+
+//! hand over the result of a query computed on another connection, it is
+//! returned by the next query() call with the same string.
+void SqlDatabase::provide_result(const std::string& query,
+                                 const SqlQuery& result)
+{
+    m_provided.insert(std::make_pair(query, result));
+}
+
+//! drop all unclaimed results handed over by provide_result().
+void SqlDatabase::clear_results()
+{
+    m_provided.clear();
+}
+
+//! submit a batch of independent read-only queries ahead of time, default
+//! implementation does nothing and all queries are run by query().
+void SqlDatabase::prefetch(const std::vector<std::string>& /* queries */)
+{
+}
+
+//! update planner statistics of a table after importing data
+void SqlDatabase::analyze(const std::string& table)
+{
+    execute("ANALYZE " + quote_field(table));
+}
+
+//! create indexes which help the given read-only queries, default
+//! implementation does nothing.
+void SqlDatabase::advise_indexes(const std::vector<std::string>& /* queries */)
+{
+}
+
+//! return a version string of the database, default implementation cannot
+//! determine one.
+std::string SqlDatabase::data_version()
+{
+    return std::string();
+}
+
+//! return names of temporary objects, default implementation knows none.
+std::set<std::string> SqlDatabase::temp_objects()
+{
+    return std::set<std::string>();
+}
+
+//! return names of virtual objects, default implementation knows none.
+std::set<std::string> SqlDatabase::virtual_objects()
+{
+    return std::set<std::string>();
+}
+
+//! test if a named object exists, default implementation cannot tell and
+//! assumes that it does.
+bool SqlDatabase::exist_object(const std::string& /* name */)
+{
+    return true;
+}
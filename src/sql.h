@@ -27,6 +27,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 
 #include <boost/shared_ptr.hpp>
 
@@ -114,6 +115,16 @@ public:
     //! enum describing supported SQL databases
     enum db_type { DB_PGSQL, DB_MYSQL, DB_SQLITE };
 
+protected:
+    //! type of m_provided
+    typedef std::multimap<std::string, SqlQuery> provided_type;
+
+    //! results of queries computed on other connections, claimed by query()
+    provided_type m_provided;
+
+    //! claim a result handed over by provide_result(), or return NULL.
+    SqlQuery claim_result(const std::string& query);
+
 public:
     //! virtual destructor to free connection
     virtual ~SqlDatabase();
@@ -140,9 +151,49 @@ public:
     virtual SqlQuery query(const std::string& query,
                            const std::vector<std::string>& params) = 0;
 
+    //! submit a batch of independent read-only queries ahead of time, their
+    //! results are returned by later query() calls with the same string.
+    virtual void prefetch(const std::vector<std::string>& queries);
+
+    //! hand over the result of a query computed on another connection, it is
+    //! returned by the next query() call with the same string.
+    void provide_result(const std::string& query, const SqlQuery& result);
+
+    //! drop all unclaimed results handed over by provide_result().
+    void clear_results();
+
+    //! number of unclaimed results handed over for the query.
+    size_t count_results(const std::string& query) const
+    {
+        return m_provided.count(query);
+    }
+
+    //! update planner statistics of a table after importing data
+    virtual void analyze(const std::string& table);
+
+    //! create indexes which help the given read-only queries
+    virtual void advise_indexes(const std::vector<std::string>& queries);
+
     //! test if a table exists in the database
     virtual bool exist_table(const std::string& table) = 0;
 
+    //! test if a table, view or other named object exists, including
+    //! temporary ones, ignoring case.
+    virtual bool exist_object(const std::string& name);
+
+    //! return a version string which changes whenever the database is
+    //! modified, or an empty string if it cannot be determined.
+    virtual std::string data_version();
+
+    //! return lower-case names of the temporary tables and views of this
+    //! connection, which other connections cannot see.
+    virtual std::set<std::string> temp_objects();
+
+    //! return lower-case names of virtual table modules, including
+    //! table-valued functions, of virtual tables and of views reading them,
+    //! whose data may come from outside the database.
+    virtual std::set<std::string> virtual_objects();
+
     //! return last error message string
     virtual const char* errmsg() const = 0;
 };
@@ -225,4 +276,56 @@ protected:
     }
 };
 
+//! Complete result of a query copied into memory, independent of the
+//! connection it was run on.
+class SqlMaterializedQuery : public SqlQueryImpl, protected SqlDataCache
+{
+protected:
+    //! column names of the result
+    std::vector<std::string> m_colnames;
+
+    //! Current result row
+    int m_row;
+
+public:
+    //! Read the complete result of a fresh query into memory.
+    SqlMaterializedQuery(SqlQueryImpl& sql);
+
+    //! Return number of rows in result.
+    unsigned int num_rows() const;
+
+    //! Return number of columns in result.
+    unsigned int num_cols() const;
+
+    // *** Column Name Mapping ***
+
+    //! Return column name of col
+    std::string col_name(unsigned int col) const;
+
+    // *** Result Iteration ***
+
+    //! Return the current row number.
+    unsigned int current_row() const;
+
+    //! Advance current result row to next (or first if uninitialized)
+    bool step();
+
+    //! Returns true if cell (current_row,col) is NULL.
+    bool isNULL(unsigned int col) const;
+
+    //! Return text representation of column col of current row.
+    std::string text(unsigned int col) const;
+
+    // *** Complete Result Caching ***
+
+    //! read complete result into memory (which it already is)
+    void read_complete();
+
+    //! Returns true if cell (row,col) is NULL.
+    bool isNULL(unsigned int row, unsigned int col) const;
+
+    //! Return text representation of cell (row,col).
+    std::string text(unsigned int row, unsigned int col) const;
+};
+
 #endif // SQL_HEADER
@@ -8,10 +8,12 @@ degrees, radians, cos, sin, tan, cot, cosh, sinh, tanh, coth, exp,
 log, log10, power, sign, sqrt, square, ceil, floor, pi.
 
 String: replicate, charindex, leftstr, rightstr, ltrim, rtrim, trim,
-replace, reverse, proper, padl, padr, padc, strfilter.
+replace, reverse, proper, padl, padr, padc, strfilter, regexp,
+regexp_replace, regexp_extract.
 
 Aggregate: stdev, variance, mode, median, lower_quartile,
-upper_quartile.
+upper_quartile, quantile, summary, approx_count_distinct, hll,
+hll_merge.
 
 The string functions ltrim, rtrim, trim, replace are included in
 recent versions of SQLite and so by default do not build.
@@ -136,73 +138,25 @@ SQLITE_EXTENSION_INIT1
 
 #include <stdlib.h>
 
-#ifndef _MAP_H_
-#define _MAP_H_
-
 // *** an always-on ASSERT
 
 #define ASSERT(expr)  do { if (!(expr)) { fprintf(stderr, "%s:%u %s: Assertion '%s' failed!\n", __FILE__, __LINE__, __PRETTY_FUNCTION__, #expr); abort(); } } while(0)
 
 #include <stdint.h>
 
-/*
-** Simple binary tree implementation to use in median, mode and quartile calculations
-** Tree is not necessarily balanced. That would require something like red&black trees of AVL
-*/
-
-typedef int(*cmp_func)(const void *, const void *);
-typedef void(*map_iterator)(void*, int64_t, void*);
-
-typedef struct node{
-  struct node *l;
-  struct node *r;
-  void* data;
-  int64_t count;
-} node;
-
-typedef struct map{
-  node *base;
-  cmp_func cmp;
-  short free;
-} map;
-
-/*
-** creates a map given a comparison function
-*/
-map map_make(cmp_func cmp);
-
-/*
-** inserts the element e into map m
-*/
-void map_insert(map *m, void *e);
-
-/*
-** executes function iter over all elements in the map, in key increasing order
-*/
-void map_iterate(map *m, map_iterator iter, void* p);
-
-/*
-** frees all memory used by a map
-*/
-void map_destroy(map *m);
-
-/*
-** compares 2 integers
-** to use with map_make
-*/
-int int_cmp(const void *a, const void *b);
-
-/*
-** compares 2 doubles
-** to use with map_make
-*/
-int double_cmp(const void *a, const void *b);
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
-#endif /* _MAP_H_ */
+#include <boost/regex.hpp>
 
 typedef uint8_t         u8;
 typedef uint16_t        u16;
 typedef int64_t         i64;
+typedef uint64_t        u64;
 
 static char *sqlite3StrDup( const char *z ) {
     char *res = (char*)sqlite3_malloc( strlen(z)+1 );
@@ -1372,6 +1326,138 @@ static void reverseFunc(sqlite3_context *context, int argc, sqlite3_value **argv
   sqlite3_free(rz);
 }
 
+/*
+** destructor of a cached compiled pattern
+*/
+static void regexpFree(void *p){
+  delete (boost::regex*)p;
+}
+
+/*
+** compile a pattern, returns 0 and sets an error if it is invalid
+*/
+static boost::regex *regexpNew(sqlite3_context *context, sqlite3_value *v){
+  const char *z = (const char*)sqlite3_value_text(v);
+  try{
+    return new boost::regex(z, z + sqlite3_value_bytes(v));
+  }catch( boost::regex_error &e ){
+    std::string msg = std::string("invalid regular expression: ") + e.what();
+    sqlite3_result_error(context, msg.c_str(), -1);
+    return 0;
+  }
+}
+
+/*
+** return the compiled pattern of argument iArg, which SQLite caches as
+** auxiliary data as long as the argument is constant in the statement. If
+** SQLite cannot keep it, a private copy is compiled into owned.
+*/
+static boost::regex *regexpCompile(sqlite3_context *context, sqlite3_value **argv,
+                                   int iArg, std::unique_ptr<boost::regex> &owned){
+  boost::regex *re = (boost::regex*)sqlite3_get_auxdata(context, iArg);
+  if( re ) return re;
+
+  if( (re = regexpNew(context, argv[iArg]))==0 ) return 0;
+
+  sqlite3_set_auxdata(context, iArg, re, regexpFree);
+  if( (boost::regex*)sqlite3_get_auxdata(context, iArg) == re ) return re;
+
+  /* the destructor was already called, e.g. during constant folding */
+  owned.reset(regexpNew(context, argv[iArg]));
+  return owned.get();
+}
+
+/*
+** regexp(pattern, text): 1 if the pattern matches a substring of text, which
+** also implements the operator "text REGEXP pattern".
+*/
+static void regexpFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  std::unique_ptr<boost::regex> owned;
+  boost::regex *re;
+  const char *z;
+
+  ASSERT( argc==2 );
+  if( sqlite3_value_type(argv[0]) == SQLITE_NULL ||
+      sqlite3_value_type(argv[1]) == SQLITE_NULL )
+    return;
+
+  if( (re = regexpCompile(context, argv, 0, owned))==0 ) return;
+
+  z = (const char*)sqlite3_value_text(argv[1]);
+  try{
+    sqlite3_result_int(context,
+        boost::regex_search(z, z + sqlite3_value_bytes(argv[1]), *re));
+  }catch( std::runtime_error &e ){
+    sqlite3_result_error(context, e.what(), -1);
+  }
+}
+
+/*
+** regexp_replace(text, pattern, replacement): replace all matches of the
+** pattern in text, the replacement may refer to groups as $1 or \1.
+*/
+static void regexpReplaceFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  std::unique_ptr<boost::regex> owned;
+  boost::regex *re;
+  const char *z;
+  std::string out;
+
+  ASSERT( argc==3 );
+  if( sqlite3_value_type(argv[0]) == SQLITE_NULL ||
+      sqlite3_value_type(argv[1]) == SQLITE_NULL ||
+      sqlite3_value_type(argv[2]) == SQLITE_NULL )
+    return;
+
+  if( (re = regexpCompile(context, argv, 1, owned))==0 ) return;
+
+  z = (const char*)sqlite3_value_text(argv[0]);
+  try{
+    boost::regex_replace(std::back_inserter(out),
+                         z, z + sqlite3_value_bytes(argv[0]), *re,
+                         (const char*)sqlite3_value_text(argv[2]));
+  }catch( std::runtime_error &e ){
+    sqlite3_result_error(context, e.what(), -1);
+    return;
+  }
+  sqlite3_result_text(context, out.data(), out.size(), SQLITE_TRANSIENT);
+}
+
+/*
+** regexp_extract(text, pattern [, group]): the first match of the pattern in
+** text or the given group of it, NULL if the pattern does not match.
+*/
+static void regexpExtractFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  std::unique_ptr<boost::regex> owned;
+  boost::regex *re;
+  boost::cmatch m;
+  const char *z;
+  int group = 0;
+
+  ASSERT( argc==2 || argc==3 );
+  if( sqlite3_value_type(argv[0]) == SQLITE_NULL ||
+      sqlite3_value_type(argv[1]) == SQLITE_NULL )
+    return;
+  if( argc==3 ) group = sqlite3_value_int(argv[2]);
+
+  if( (re = regexpCompile(context, argv, 1, owned))==0 ) return;
+
+  if( group<0 || group>(int)re->mark_count() ){
+    sqlite3_result_error(context, "regexp_extract: invalid group number", -1);
+    return;
+  }
+
+  z = (const char*)sqlite3_value_text(argv[0]);
+  try{
+    if( !boost::regex_search(z, z + sqlite3_value_bytes(argv[0]), m, *re) )
+      return;
+  }catch( std::runtime_error &e ){
+    sqlite3_result_error(context, e.what(), -1);
+    return;
+  }
+  if( m[group].matched )
+    sqlite3_result_text(context, m[group].first, m[group].length(), SQLITE_TRANSIENT);
+}
+
 /*
 ** An instance of the following structure holds the context of a
 ** stdev() or variance() aggregate computation.
@@ -1386,43 +1472,70 @@ struct StdevCtx {
 };
 
 /*
-** An instance of the following structure holds the context of a
-** mode() or median() aggregate computation.
-** Depends on structures defined in map.c (see map & map)
+** Order statistics of a sliding window, used when median(), quartiles or
+** quantile() are evaluated as window functions. The k smallest values are
+** kept in lo and the others in hi, such that the values bracketing a quantile
+** are at the boundary. Adding, removing and rebalancing take O(log w).
+*/
+typedef struct ModeWindow ModeWindow;
+struct ModeWindow {
+  std::multiset<double> lo;   /* k smallest values */
+  std::multiset<double> hi;   /* remaining values */
+  i64 ndouble;                /* number of non-integer values in window */
+
+  ModeWindow() : ndouble(0) { }
+
+  size_t size() const { return lo.size() + hi.size(); }
+
+  void insert(double x, int is_int){
+    if( !lo.empty() && x <= *lo.rbegin() )
+      lo.insert(x);
+    else
+      hi.insert(x);
+    if( !is_int ) ++ndouble;
+  }
+
+  void remove(double x, int is_int){
+    /* values equal to the maximum of lo may be in either set */
+    if( !lo.empty() && x <= *lo.rbegin() )
+      lo.erase(lo.find(x));
+    else if( hi.find(x) != hi.end() )
+      hi.erase(hi.find(x));
+    if( !is_int ) --ndouble;
+  }
+
+  /* move values until lo contains the k smallest */
+  void balance(size_t k){
+    while( lo.size() > k ){
+      hi.insert(*lo.rbegin());
+      lo.erase(--lo.end());
+    }
+    while( lo.size() < k ){
+      lo.insert(*hi.begin());
+      hi.erase(hi.begin());
+    }
+  }
+};
+
+/*
+** An instance of the following structure holds the context of a mode(),
+** median(), lower_quartile(), upper_quartile() or quantile() aggregate
+** computation. All values are appended to a contiguous buffer, which is
+** partially ordered with nth_element() (quantiles) or sorted (mode) when the
+** result is computed.
+** Values are kept as integers until the first non-integer value arrives,
+** then the buffer is converted to doubles.
 ** These aggregate functions only work for integers and floats although
 ** they could be made to work for strings. This is usually considered meaningless.
-** Only usuall order (for median), no use of collation functions (would this even make sense?)
 */
 typedef struct ModeCtx ModeCtx;
 struct ModeCtx {
-  i64 riM;            /* integer value found so far */
-  double rdM;         /* double value found so far */
-  i64 cnt;            /* number of elements so far */
-  double pcnt;        /* number of elements smaller than a percentile */
-  i64 mcnt;           /* maximum number of occurrences (for mode) */
-  i64 mn;             /* number of occurrences (for mode and percentiles) */
-  i64 is_double;      /* whether the computation is being done for doubles (>0) or integers (=0) */
-  map* m;             /* map structure used for the computation */
-  int done;           /* whether the answer has been found */
-};
-
-/*
-** Like ModeCtx, but with an additional integer or double argument.
-** Used for computing arbitrary quantiles as aggregates with quantile()
- */
-typedef struct ModeArgCtx ModeArgCtx;
-struct ModeArgCtx {
-  i64 riM;            /* integer value found so far */
-  double rdM;         /* double value found so far */
-  i64 cnt;            /* number of elements so far */
-  double pcnt;        /* number of elements smaller than a percentile */
-  i64 mcnt;           /* maximum number of occurrences (for mode) */
-  i64 mn;             /* number of occurrences (for mode and percentiles) */
-  i64 is_double;      /* whether the computation is being done for doubles (>0) or integers (=0) */
-  map* m;             /* map structure used for the computation */
-  i64 argi;           /* integer argument */
-  double argd;        /* double argument */
-  int done;           /* whether the answer has been found */
+  std::vector<i64> *vi;     /* integer values, while all values are integers */
+  std::vector<double> *vd;  /* double values, once a non-integer was seen */
+  ModeWindow *win;          /* sliding window, when used as window function */
+  i64 ndouble;              /* number of non-integer values buffered */
+  double q;                 /* quantile argument of quantile() */
+  int has_q;                /* whether the quantile argument was read */
 };
 
 /*
@@ -1447,14 +1560,122 @@ static void varianceStep(sqlite3_context *context, int argc, sqlite3_value **arg
 }
 
 /*
-** called for each value received during a calculation of mode of median
+** called for each value leaving the window frame of stdev or variance,
+** reverts the update of varianceStep
+*/
+static void varianceInverse(sqlite3_context *context, int argc, sqlite3_value **argv){
+  StdevCtx *p;
+
+  double delta;
+  double x;
+
+  ASSERT( argc==1 );
+  p = (StdevCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( SQLITE_NULL != sqlite3_value_numeric_type(argv[0]) ){
+    p->cnt--;
+    if( p->cnt==0 ){
+      p->rM = 0.0;
+      p->rS = 0.0;
+    }else{
+      x = sqlite3_value_double(argv[0]);
+      delta = (x-p->rM);
+      p->rM -= delta/p->cnt;
+      p->rS -= delta*(x-p->rM);
+    }
+  }
+}
+
+/*
+** append a non-NULL value to the buffer of a ModeCtx
+*/
+static void modeAppend(ModeCtx *p, sqlite3_value *v, int type){
+  if( p->win ){
+    p->win->insert(sqlite3_value_double(v), type==SQLITE_INTEGER);
+    return;
+  }
+
+  if( 0==p->vi && 0==p->vd ){
+    p->vi = new std::vector<i64>;
+  }
+
+  if( p->vi && type!=SQLITE_INTEGER ){
+    /* first non-integer value: convert buffer to doubles */
+    p->vd = new std::vector<double>(p->vi->begin(), p->vi->end());
+    delete p->vi;
+    p->vi = 0;
+  }
+
+  if( p->vi )
+    p->vi->push_back(sqlite3_value_int64(v));
+  else
+    p->vd->push_back(sqlite3_value_double(v));
+
+  if( type!=SQLITE_INTEGER ) ++p->ndouble;
+}
+
+/*
+** free the buffers of a ModeCtx
+*/
+static void modeFree(ModeCtx *p){
+  delete p->vi;
+  delete p->vd;
+  delete p->win;
+  p->vi = 0;
+  p->vd = 0;
+  p->win = 0;
+}
+
+/*
+** switch a ModeCtx to window mode on the first xValue or xInverse call, the
+** buffered values are moved into the window structure.
+*/
+static ModeWindow* modeWindow(ModeCtx *p){
+  size_t i;
+  if( p->win ) return p->win;
+
+  p->win = new ModeWindow;
+  if( p->vi ){
+    for(i=0; i<p->vi->size(); ++i)
+      p->win->insert((*p->vi)[i], 1);
+  }
+  if( p->vd ){
+    /* integers were converted, only the count of non-integers is kept */
+    for(i=0; i<p->vd->size(); ++i)
+      p->win->insert((*p->vd)[i], 1);
+    p->win->ndouble = p->ndouble;
+  }
+  delete p->vi;
+  delete p->vd;
+  p->vi = 0;
+  p->vd = 0;
+  return p->win;
+}
+
+/*
+** called for each value leaving the window frame of median, quartiles or
+** quantile evaluated as window functions
+*/
+static void modeInverse(sqlite3_context *context, int argc, sqlite3_value **argv){
+  ModeCtx *p;
+  int type;
+
+  type = sqlite3_value_numeric_type(argv[0]);
+
+  if( type == SQLITE_NULL || (argc==2 && sqlite3_value_numeric_type(argv[1]) == SQLITE_NULL) )
+    return;
+
+  p = (ModeCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 ) return;
+
+  modeWindow(p)->remove(sqlite3_value_double(argv[0]), type==SQLITE_INTEGER);
+}
+
+/*
+** called for each value received during a calculation of mode, median or
+** quartiles
 */
 static void modeStep(sqlite3_context *context, int argc, sqlite3_value **argv){
   ModeCtx *p;
-  i64 xi=0;
-  double xd=0.0;
-  i64 *iptr;
-  double *dptr;
   int type;
 
   ASSERT( argc==1 );
@@ -1464,45 +1685,17 @@ static void modeStep(sqlite3_context *context, int argc, sqlite3_value **argv){
     return;
 
   p = (ModeCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 ) return;
 
-  if( 0==(p->m) ){
-    p->m = (map*)calloc(1, sizeof(map));
-    if( type==SQLITE_INTEGER ){
-      /* map will be used for integers */
-      *(p->m) = map_make(int_cmp);
-      p->is_double = 0;
-    }else{
-      p->is_double = 1;
-      /* map will be used for doubles */
-      *(p->m) = map_make(double_cmp);
-    }
-  }
-
-  ++(p->cnt);
-
-  if( 0==p->is_double ){
-    xi = sqlite3_value_int64(argv[0]);
-    iptr = (i64*)calloc(1,sizeof(i64));
-    *iptr = xi;
-    map_insert(p->m, iptr);
-  }else{
-    xd = sqlite3_value_double(argv[0]);
-    dptr = (double*)calloc(1,sizeof(double));
-    *dptr = xd;
-    map_insert(p->m, dptr);
-  }
+  modeAppend(p, argv[0], type);
 }
 
-
 /*
-** called for each value received during a calculation of mode of median
+** called for each value received during a calculation of quantile, the
+** quantile argument is taken from the first row.
 */
 static void modeStepArg(sqlite3_context *context, int argc, sqlite3_value **argv){
-  ModeArgCtx *p;
-  i64 xi=0;
-  double xd=0.0;
-  i64 *iptr;
-  double *dptr;
+  ModeCtx *p;
   int type1, type2;
 
   ASSERT( argc==2 );
@@ -1512,113 +1705,64 @@ static void modeStepArg(sqlite3_context *context, int argc, sqlite3_value **argv
   if( type1 == SQLITE_NULL || type2 == SQLITE_NULL)
     return;
 
-  p = (ModeArgCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  p = (ModeCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 ) return;
 
-  if( 0==(p->m) ){
-    p->m = (map*)calloc(1, sizeof(map));
-    if( type1==SQLITE_INTEGER ){
-      /* map will be used for integers */
-      *(p->m) = map_make(int_cmp);
-      p->is_double = 0;
-    }else{
-      p->is_double = 1;
-      /* map will be used for doubles */
-      *(p->m) = map_make(double_cmp);
-    }
-    /* parse the argument */
-    if( type2==SQLITE_INTEGER ){
-        /* integer argument */
-        p->argi = sqlite3_value_int64(argv[0]);
-    }else{
-        /* double argument */
-        p->argd = sqlite3_value_double(argv[1]);
-    }
+  if( !p->has_q ){
+    /* integer or double argument */
+    p->q = sqlite3_value_double(argv[1]);
+    p->has_q = 1;
   }
 
-  ++(p->cnt);
-
-  if( 0==p->is_double ){
-    xi = sqlite3_value_int64(argv[0]);
-    iptr = (i64*)calloc(1,sizeof(i64));
-    *iptr = xi;
-    map_insert(p->m, iptr);
-  }else{
-    xd = sqlite3_value_double(argv[0]);
-    dptr = (double*)calloc(1,sizeof(double));
-    *dptr = xd;
-    map_insert(p->m, dptr);
-  }
+  modeAppend(p, argv[0], type1);
 }
 
 /*
-**  Auxiliary function that iterates all elements in a map and finds the mode
-**  (most frequent value)
+** Selects the values bracketing position pcnt in the sorted order of v:
+** the value such that the number of elements smaller is at most pcnt and
+** the number of elements larger is at most cnt - pcnt. If pcnt falls exactly
+** between two elements, both neighbours are returned. Runs in linear time.
 */
-static void modeIterate(void* e, i64 c, void* pp){
-  i64 ei;
-  double ed;
-  ModeCtx *p = (ModeCtx*)pp;
+template <typename T>
+static void quantileSelect(std::vector<T>& v, double pcnt, T& lo, T& hi){
+  size_t n = v.size();
+  size_t k = (size_t)pcnt;
 
-  if( 0==p->is_double ){
-    ei = *(int*)(e);
+  if( k >= n ) k = n-1;
 
-        if( p->mcnt==c ){
-      ++p->mn;
-    }else if( p->mcnt<c ){
-      p->riM = ei;
-      p->mcnt = c;
-          p->mn=1;
-    }
-  }else{
-    ed = *(double*)(e);
-
-        if( p->mcnt==c ){
-      ++p->mn;
-    }else if(p->mcnt<c){
-      p->rdM = ed;
-      p->mcnt = c;
-          p->mn=1;
-    }
+  std::nth_element(v.begin(), v.begin()+k, v.end());
+  lo = hi = v[k];
+
+  if( pcnt==(double)k && k>0 ){
+    /* between elements k-1 and k: largest of the lower partition */
+    lo = *std::max_element(v.begin(), v.begin()+k);
   }
 }
 
 /*
-**  Auxiliary function that iterates all elements in a map and finds the median
-**  (the value such that the number of elements smaller is equal the the number of
-**  elements larger)
+** Finds the mode (most frequent value) of v by sorting and counting runs.
+** Returns 0 if the maximum number of occurrences is not unique.
 */
-static void medianIterate(void* e, i64 c, void* pp){
-  i64 ei;
-  double ed;
-  double iL;
-  double iR;
-  int il;
-  int ir;
-  ModeCtx *p = (ModeCtx*)pp;
+template <typename T>
+static int modeSelect(std::vector<T>& v, T& mode){
+  i64 mcnt = 0;  /* maximum number of occurrences */
+  i64 mn = 0;    /* number of values with mcnt occurrences */
+  size_t i, j;
 
-  if(p->done>0)
-    return;
+  std::sort(v.begin(), v.end());
 
-  iL = p->pcnt;
-  iR = p->cnt - p->pcnt;
-  il = p->mcnt + c;
-  ir = p->cnt - p->mcnt;
-
-  if( il >= iL ){
-    if( ir >= iR ){
-    ++p->mn;
-      if( 0==p->is_double ){
-        ei = *(int*)(e);
-        p->riM += ei;
-      }else{
-        ed = *(double*)(e);
-        p->rdM += ed;
-      }
-    }else{
-      p->done=1;
+  for(i=0; i<v.size(); i=j){
+    for(j=i+1; j<v.size() && v[j]==v[i]; ++j) { }
+
+    if( (i64)(j-i) == mcnt ){
+      ++mn;
+    }else if( (i64)(j-i) > mcnt ){
+      mode = v[i];
+      mcnt = j-i;
+      mn = 1;
     }
   }
-  p->mcnt+=c;
+  return mn==1;
 }
 
 /*
@@ -1627,40 +1771,65 @@ static void medianIterate(void* e, i64 c, void* pp){
 static void modeFinalize(sqlite3_context *context){
   ModeCtx *p;
   p = (ModeCtx*)sqlite3_aggregate_context(context, 0);
-  if( p && p->m ){
-    map_iterate(p->m, modeIterate, p);
-    map_destroy(p->m);
-    free(p->m);
-
-    if( 1==p->mn ){
-      if( 0==p->is_double )
-        sqlite3_result_int64(context, p->riM);
-      else
-        sqlite3_result_double(context, p->rdM);
-    }
+  if( p && p->vi ){
+    i64 mi = 0;
+    if( modeSelect(*p->vi, mi) )
+      sqlite3_result_int64(context, mi);
+  }else if( p && p->vd ){
+    double md = 0.0;
+    if( modeSelect(*p->vd, md) )
+      sqlite3_result_double(context, md);
   }
+  if( p ) modeFree(p);
 }
 
 /*
-** auxiliary function for percentiles
+** auxiliary function for percentiles of the current window frame, same
+** results as _medianFinalize.
 */
-static void _medianFinalize(sqlite3_context *context){
-  ModeCtx *p;
-  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
-  if( p && p->m ){
-    p->done=0;
-    map_iterate(p->m, medianIterate, p);
-    map_destroy(p->m);
-    free(p->m);
-
-    if( 0==p->is_double )
-      if( 1==p->mn )
-        sqlite3_result_int64(context, p->riM);
-      else
-        sqlite3_result_double(context, p->riM*1.0/p->mn);
+static void _medianValue(sqlite3_context *context, ModeCtx *p, double q){
+  ModeWindow *w = modeWindow(p);
+  size_t n = w->size(), k;
+  double pcnt, lo, hi;
+
+  if( n==0 || !(q>=0.0 && q<=1.0) )
+    return;
+
+  pcnt = n * q;
+  k = (size_t)pcnt;
+  if( k >= n ) k = n-1;
+
+  w->balance(k);
+  lo = hi = *w->hi.begin();
+  if( pcnt==(double)k && k>0 )
+    lo = *w->lo.rbegin();
+
+  if( lo==hi && 0==w->ndouble )
+    sqlite3_result_int64(context, (i64)lo);
+  else
+    sqlite3_result_double(context, lo==hi ? lo : (lo + hi)/2);
+}
+
+/*
+** auxiliary function for percentiles: returns the average of the distinct
+** values bracketing the quantile q, or NULL for q outside [0,1].
+*/
+static void _medianFinalize(sqlite3_context *context, ModeCtx *p, double q){
+  if( p->win ){
+    _medianValue(context, p, q);
+  }else if( p->vi && !p->vi->empty() && q>=0.0 && q<=1.0 ){
+    i64 lo, hi;
+    quantileSelect(*p->vi, p->vi->size() * q, lo, hi);
+    if( lo==hi )
+      sqlite3_result_int64(context, lo);
     else
-      sqlite3_result_double(context, p->rdM/p->mn);
+      sqlite3_result_double(context, (lo*1.0 + hi*1.0)/2);
+  }else if( p->vd && !p->vd->empty() && q>=0.0 && q<=1.0 ){
+    double lo, hi;
+    quantileSelect(*p->vd, p->vd->size() * q, lo, hi);
+    sqlite3_result_double(context, lo==hi ? lo : (lo + hi)/2);
   }
+  modeFree(p);
 }
 
 /*
@@ -1670,8 +1839,7 @@ static void medianFinalize(sqlite3_context *context){
   ModeCtx *p;
   p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
   if( p!=0 ){
-    p->pcnt = (p->cnt)/2.0;
-    _medianFinalize(context);
+    _medianFinalize(context, p, 0.5);
   }
 }
 
@@ -1682,8 +1850,7 @@ static void lower_quartileFinalize(sqlite3_context *context){
   ModeCtx *p;
   p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
   if( p!=0 ){
-    p->pcnt = (p->cnt)/4.0;
-    _medianFinalize(context);
+    _medianFinalize(context, p, 0.25);
   }
 }
 
@@ -1694,8 +1861,7 @@ static void upper_quartileFinalize(sqlite3_context *context){
   ModeCtx *p;
   p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
   if( p!=0 ){
-    p->pcnt = (p->cnt)*3/4.0;
-    _medianFinalize(context);
+    _medianFinalize(context, p, 0.75);
   }
 }
 
@@ -1704,13 +1870,270 @@ static void upper_quartileFinalize(sqlite3_context *context){
 ** The quantile was passed to the step function
 */
 static void quantileFinalize(sqlite3_context *context){
-    ModeArgCtx *p;
-    p = (ModeArgCtx*) sqlite3_aggregate_context(context, 0);
+    ModeCtx *p;
+    p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
     if( p!=0 ){
-        /* quantile is stored in p->arg */
-        p->pcnt = (p->cnt)*(p->argd);
-        _medianFinalize(context);
+        /* quantile is stored in p->q */
+        _medianFinalize(context, p, p->q);
+    }
+}
+
+/*
+** Returns the median value of the current window frame
+*/
+static void medianValue(sqlite3_context *context){
+  ModeCtx *p;
+  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
+  if( p!=0 ){
+    _medianValue(context, p, 0.5);
+  }
+}
+
+/*
+** Returns the lower_quartile value of the current window frame
+*/
+static void lower_quartileValue(sqlite3_context *context){
+  ModeCtx *p;
+  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
+  if( p!=0 ){
+    _medianValue(context, p, 0.25);
+  }
+}
+
+/*
+** Returns the upper_quartile value of the current window frame
+*/
+static void upper_quartileValue(sqlite3_context *context){
+  ModeCtx *p;
+  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
+  if( p!=0 ){
+    _medianValue(context, p, 0.75);
+  }
+}
+
+/*
+** Returns an arbitrary quantile of the current window frame
+*/
+static void quantileValue(sqlite3_context *context){
+  ModeCtx *p;
+  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
+  if( p!=0 ){
+    _medianValue(context, p, p->q);
+  }
+}
+
+/*
+** An instance of the following structure holds the context of a summary()
+** aggregate: count, mean, stdev, min, max and requested quantiles are computed
+** in one pass, the quantiles from one shared value buffer.
+*/
+typedef struct SummaryCtx SummaryCtx;
+struct SummaryCtx {
+  ModeCtx m;                /* value buffer for the quantiles */
+  std::vector<double> *qs;  /* requested quantiles, from the first row */
+  i64 cnt;                  /* number of elements */
+  double rM;                /* running mean */
+  double rS;                /* running sum of squared differences */
+  double rMin, rMax;        /* minimum and maximum */
+};
+
+/*
+** Layout of the blob returned by summary(): header values followed by
+** (quantile, value, is_integer) triples, all stored as doubles.
+*/
+enum { SUMMARY_COUNT, SUMMARY_MEAN, SUMMARY_STDEV, SUMMARY_MIN, SUMMARY_MAX,
+       SUMMARY_ISINT, SUMMARY_NQ, SUMMARY_HEADER };
+
+/*
+** called for each row of summary(x, q1, q2, ...)
+*/
+static void summaryStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  SummaryCtx *p;
+  int type, i;
+  double x, delta;
+
+  if( argc<1 ){
+    sqlite3_result_error(context, "summary() requires a value argument", -1);
+    return;
+  }
+  type = sqlite3_value_numeric_type(argv[0]);
+
+  if( type == SQLITE_NULL )
+    return;
+
+  p = (SummaryCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 ) return;
+
+  if( p->qs==0 ){
+    p->qs = new std::vector<double>;
+    for(i=1; i<argc; ++i)
+      p->qs->push_back(sqlite3_value_numeric_type(argv[i]) == SQLITE_NULL
+                       ? -1.0 : sqlite3_value_double(argv[i]));
+  }
+
+  x = sqlite3_value_double(argv[0]);
+  if( p->cnt==0 || x < p->rMin ) p->rMin = x;
+  if( p->cnt==0 || x > p->rMax ) p->rMax = x;
+
+  p->cnt++;
+  delta = (x-p->rM);
+  p->rM += delta/p->cnt;
+  p->rS += delta*(x-p->rM);
+
+  modeAppend(&p->m, argv[0], type);
+}
+
+/*
+** Returns the summary blob
+*/
+static void summaryFinalize(sqlite3_context *context){
+  SummaryCtx *p;
+  std::vector<double> out;
+  size_t i;
+
+  p = (SummaryCtx*)sqlite3_aggregate_context(context, 0);
+  if( p==0 || p->cnt==0 ){
+    if( p ){ modeFree(&p->m); delete p->qs; }
+    return;
+  }
+
+  out.resize(SUMMARY_HEADER);
+  out[SUMMARY_COUNT] = p->cnt;
+  out[SUMMARY_MEAN] = p->rM;
+  out[SUMMARY_STDEV] = p->cnt>1 ? sqrt(p->rS/(p->cnt-1)) : 0.0;
+  out[SUMMARY_MIN] = p->rMin;
+  out[SUMMARY_MAX] = p->rMax;
+  out[SUMMARY_ISINT] = p->m.vi ? 1 : 0;
+  out[SUMMARY_NQ] = p->qs->size();
+
+  for(i=0; i<p->qs->size(); ++i){
+    double q = (*p->qs)[i];
+    out.push_back(q);
+    if( !(q>=0.0 && q<=1.0) ){
+      out.push_back(NAN);
+      out.push_back(0);
+    }else if( p->m.vi ){
+      i64 lo, hi;
+      quantileSelect(*p->m.vi, p->m.vi->size() * q, lo, hi);
+      out.push_back(lo==hi ? lo : (lo*1.0 + hi*1.0)/2);
+      out.push_back(lo==hi ? 1 : 0);
+    }else{
+      double lo, hi;
+      quantileSelect(*p->m.vd, p->m.vd->size() * q, lo, hi);
+      out.push_back(lo==hi ? lo : (lo + hi)/2);
+      out.push_back(0);
     }
+  }
+
+  sqlite3_result_blob(context, out.data(), out.size() * sizeof(double),
+                      SQLITE_TRANSIENT);
+
+  modeFree(&p->m);
+  delete p->qs;
+}
+
+/*
+** read a summary blob, returns the number of doubles or 0 if invalid. The
+** quantile count and the row count are checked to be integers in range before
+** converting them, the blob may come from anywhere.
+*/
+static size_t summaryRead(sqlite3_context *context, sqlite3_value *v,
+                          std::vector<double>& out){
+  size_t n;
+  double nq, cnt;
+
+  if( sqlite3_value_type(v) != SQLITE_BLOB )
+    return 0;
+
+  n = sqlite3_value_bytes(v) / sizeof(double);
+  out.resize(n);
+  if( n ) memcpy(out.data(), sqlite3_value_blob(v), n * sizeof(double));
+
+  nq = n >= SUMMARY_HEADER ? out[SUMMARY_NQ] : -1;
+  cnt = n >= SUMMARY_HEADER ? out[SUMMARY_COUNT] : -1;
+  if( n < SUMMARY_HEADER
+      || !(nq >= 0 && nq <= (double)((n - SUMMARY_HEADER) / 3)) || nq != floor(nq)
+      || !(cnt >= 0 && cnt < 9223372036854775808.0) || cnt != floor(cnt)
+      || n != SUMMARY_HEADER + 3 * (size_t)nq ){
+    sqlite3_result_error(context, "invalid summary() value", -1);
+    return 0;
+  }
+  return n;
+}
+
+/*
+** result a double of the summary, as integer if the values were integers
+*/
+static void summaryResult(sqlite3_context *context, double v, int is_int){
+  if( v != v )
+    return;
+  if( is_int )
+    sqlite3_result_int64(context, (i64)v);
+  else
+    sqlite3_result_double(context, v);
+}
+
+/*
+** auxiliary function for summary_count(s), summary_mean(s), summary_stdev(s),
+** summary_min(s) and summary_max(s)
+*/
+static void _summaryField(sqlite3_context *context, int argc, sqlite3_value **argv, int field){
+  std::vector<double> s;
+
+  ASSERT( argc==1 );
+  if( !summaryRead(context, argv[0], s) )
+    return;
+
+  if( field==SUMMARY_COUNT )
+    sqlite3_result_int64(context, (i64)s[SUMMARY_COUNT]);
+  else if( field==SUMMARY_MIN || field==SUMMARY_MAX )
+    summaryResult(context, s[field], s[SUMMARY_ISINT] != 0);
+  else
+    sqlite3_result_double(context, s[field]);
+}
+
+static void summaryCountFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  _summaryField(context, argc, argv, SUMMARY_COUNT);
+}
+
+static void summaryMeanFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  _summaryField(context, argc, argv, SUMMARY_MEAN);
+}
+
+static void summaryStdevFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  _summaryField(context, argc, argv, SUMMARY_STDEV);
+}
+
+static void summaryMinFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  _summaryField(context, argc, argv, SUMMARY_MIN);
+}
+
+static void summaryMaxFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  _summaryField(context, argc, argv, SUMMARY_MAX);
+}
+
+/*
+** summary_quantile(s, q): one of the quantiles requested from summary(),
+** NULL if q was not requested.
+*/
+static void summaryQuantileFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  std::vector<double> s;
+  double q;
+  size_t i;
+
+  ASSERT( argc==2 );
+  if( !summaryRead(context, argv[0], s) )
+    return;
+  if( sqlite3_value_numeric_type(argv[1]) == SQLITE_NULL )
+    return;
+
+  q = sqlite3_value_double(argv[1]);
+  for(i=SUMMARY_HEADER; i+2<s.size(); i+=3){
+    if( fabs(s[i]-q) < 1e-12 ){
+      summaryResult(context, s[i+1], s[i+2] != 0);
+      return;
+    }
+  }
 }
 
 /*
@@ -1739,6 +2162,225 @@ static void varianceFinalize(sqlite3_context *context){
   }
 }
 
+/*
+** An instance of the following structure holds the context of a HyperLogLog
+** sketch used by approx_count_distinct(), hll() and hll_merge(). The
+** serialized form is one byte with the precision followed by the registers.
+*/
+typedef struct HllCtx HllCtx;
+struct HllCtx {
+  std::vector<u8> *reg;     /* 2^p registers with maximum ranks */
+  int p;                    /* precision, number of index bits */
+};
+
+#define HLL_DEFAULT_PRECISION 14
+
+/*
+** 64-bit finalizer of MurmurHash3, spreads the bits of a hash value
+*/
+static u64 hllMix(u64 h){
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/*
+** hash a value, such that numbers equal in SQL hash equal
+*/
+static u64 hllHash(sqlite3_value *v, int type){
+  u64 h;
+  const u8 *z;
+  int i, n;
+
+  if( type==SQLITE_INTEGER || type==SQLITE_FLOAT ){
+    double d = sqlite3_value_double(v);
+    i64 iv = sqlite3_value_int64(v);
+    if( type==SQLITE_INTEGER || d==(double)iv ){
+      h = (u64)iv;
+    }else{
+      memcpy(&h, &d, sizeof(h));
+      h ^= 0x9e3779b97f4a7c15ULL;
+    }
+    return hllMix(h);
+  }
+
+  /* FNV-1a over the bytes of text and blobs, tagged by type */
+  if( type==SQLITE_TEXT ){
+    z = sqlite3_value_text(v);
+  }else{
+    z = (const u8*)sqlite3_value_blob(v);
+  }
+  n = sqlite3_value_bytes(v);
+  h = 0xcbf29ce484222325ULL ^ (u64)type;
+  for(i=0; i<n; i++){
+    h ^= z[i];
+    h *= 0x100000001b3ULL;
+  }
+  return hllMix(h);
+}
+
+/*
+** allocate the registers on first use with the given precision
+*/
+static HllCtx *hllContext(sqlite3_context *context, int p){
+  HllCtx *c = (HllCtx*)sqlite3_aggregate_context(context, sizeof(*c));
+  if( c==0 ) return 0;
+  if( c->reg==0 ){
+    c->p = p;
+    c->reg = new std::vector<u8>((size_t)1 << p, 0);
+  }
+  return c;
+}
+
+/*
+** called for each row of approx_count_distinct(x [, precision]) and
+** hll(x [, precision])
+*/
+static void hllStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  HllCtx *c;
+  int type, p = HLL_DEFAULT_PRECISION, rank;
+  u64 h, w;
+
+  if( argc>1 && sqlite3_value_numeric_type(argv[1]) != SQLITE_NULL ){
+    p = sqlite3_value_int(argv[1]);
+    if( p<4 || p>18 ){
+      sqlite3_result_error(context, "HyperLogLog precision must be in [4,18]", -1);
+      return;
+    }
+  }
+
+  type = sqlite3_value_type(argv[0]);
+  if( type==SQLITE_NULL ) return;
+
+  c = hllContext(context, p);
+  if( c==0 ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+
+  h = hllHash(argv[0], type);
+
+  /* the top p bits select the register, the rank is the position of the
+  ** first one bit in the remaining bits */
+  w = (h << c->p) | ((u64)1 << (c->p - 1));
+  rank = __builtin_clzll(w) + 1;
+
+  u8 &r = (*c->reg)[h >> (64 - c->p)];
+  if( rank > r ) r = (u8)rank;
+}
+
+/*
+** called for each row of hll_merge(sketch): maximum of the registers
+*/
+static void hllMergeStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  HllCtx *c;
+  const u8 *z;
+  int n, p;
+  size_t i;
+
+  ASSERT( argc==1 );
+  if( sqlite3_value_type(argv[0]) == SQLITE_NULL ) return;
+
+  z = (const u8*)sqlite3_value_blob(argv[0]);
+  n = sqlite3_value_bytes(argv[0]);
+  p = n>0 ? z[0] : 0;
+  if( sqlite3_value_type(argv[0]) != SQLITE_BLOB || p<4 || p>18
+      || n != 1 + (1 << p) ){
+    sqlite3_result_error(context, "invalid hll() value", -1);
+    return;
+  }
+
+  c = hllContext(context, p);
+  if( c==0 ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  if( c->p != p ){
+    sqlite3_result_error(context, "hll_merge() of sketches with different precision", -1);
+    return;
+  }
+
+  for(i=0; i<c->reg->size(); i++){
+    if( z[1+i] > (*c->reg)[i] ) (*c->reg)[i] = z[1+i];
+  }
+}
+
+/*
+** estimate the number of distinct values from the registers, using linear
+** counting for small cardinalities
+*/
+static double hllEstimate(const u8 *reg, int p){
+  double m = (double)((size_t)1 << p), sum = 0, alpha, e;
+  size_t i, zeros = 0;
+
+  for(i=0; i<(size_t)1 << p; i++){
+    sum += ldexp(1.0, -reg[i]);
+    if( reg[i]==0 ) zeros++;
+  }
+
+  if( p==4 ) alpha = 0.673;
+  else if( p==5 ) alpha = 0.697;
+  else if( p==6 ) alpha = 0.709;
+  else alpha = 0.7213/(1.0 + 1.079/m);
+
+  e = alpha * m * m / sum;
+  if( e <= 2.5 * m && zeros ){
+    e = m * log(m / zeros);
+  }
+  return e;
+}
+
+/*
+** Returns the estimated number of distinct values
+*/
+static void hllCountFinalize(sqlite3_context *context){
+  HllCtx *c = (HllCtx*)sqlite3_aggregate_context(context, 0);
+  if( c==0 || c->reg==0 ){
+    sqlite3_result_int64(context, 0);
+    return;
+  }
+  sqlite3_result_int64(context, (i64)floor(hllEstimate(c->reg->data(), c->p) + 0.5));
+  delete c->reg;
+}
+
+/*
+** Returns the serialized sketch, NULL if there were no values
+*/
+static void hllFinalize(sqlite3_context *context){
+  HllCtx *c = (HllCtx*)sqlite3_aggregate_context(context, 0);
+  std::vector<u8> out;
+  if( c==0 || c->reg==0 ) return;
+
+  out.push_back((u8)c->p);
+  out.insert(out.end(), c->reg->begin(), c->reg->end());
+  sqlite3_result_blob(context, out.data(), out.size(), SQLITE_TRANSIENT);
+  delete c->reg;
+}
+
+/*
+** hll_count(sketch): estimated number of distinct values of a sketch
+*/
+static void hllCountFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  const u8 *z;
+  int n, p;
+
+  ASSERT( argc==1 );
+  if( sqlite3_value_type(argv[0]) == SQLITE_NULL ) return;
+
+  z = (const u8*)sqlite3_value_blob(argv[0]);
+  n = sqlite3_value_bytes(argv[0]);
+  p = n>0 ? z[0] : 0;
+  if( sqlite3_value_type(argv[0]) != SQLITE_BLOB || p<4 || p>18
+      || n != 1 + (1 << p) ){
+    sqlite3_result_error(context, "invalid hll() value", -1);
+    return;
+  }
+  sqlite3_result_int64(context, (i64)floor(hllEstimate(z+1, p) + 0.5));
+}
+
 #ifdef SQLITE_SOUNDEX
 
 /* relicoder factored code */
@@ -1823,7 +2465,7 @@ int RegisterExtensionFunctions(sqlite3 *db){
      const char *zName;
      signed char nArg;
      u8 argType;           /* 0: none.  1: db  2: (-1) */
-     u8 eTextRep;          /* 1: UTF-16.  0: UTF-8 */
+     int eTextRep;         /* encoding and SQLITE_DETERMINISTIC */
      u8 needCollSeq;
      void (*xFunc)(sqlite3_context*,int,sqlite3_value **);
   } aFuncs[] = {
@@ -1886,6 +2528,23 @@ int RegisterExtensionFunctions(sqlite3 *db){
     { "padc",               2, 0, SQLITE_UTF8,    0, padcFunc },
     { "strfilter",          2, 0, SQLITE_UTF8,    0, strfilterFunc },
 
+    /* regular expressions with Boost.Regex */
+    { "regexp",             2, 0, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, regexpFunc },
+    { "regexp_replace",     3, 0, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, regexpReplaceFunc },
+    { "regexp_extract",     2, 0, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, regexpExtractFunc },
+    { "regexp_extract",     3, 0, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, regexpExtractFunc },
+
+    /* accessors of summary() */
+    { "summary_count",      1, 0, SQLITE_UTF8,    0, summaryCountFunc },
+    { "summary_mean",       1, 0, SQLITE_UTF8,    0, summaryMeanFunc },
+    { "summary_stdev",      1, 0, SQLITE_UTF8,    0, summaryStdevFunc },
+    { "summary_min",        1, 0, SQLITE_UTF8,    0, summaryMinFunc },
+    { "summary_max",        1, 0, SQLITE_UTF8,    0, summaryMaxFunc },
+    { "summary_quantile",   2, 0, SQLITE_UTF8,    0, summaryQuantileFunc },
+
+    /* estimate of hll() sketches */
+    { "hll_count",          1, 0, SQLITE_UTF8,    0, hllCountFunc },
+
   };
   /* Aggregate functions */
   static const struct FuncDefAgg {
@@ -1895,14 +2554,23 @@ int RegisterExtensionFunctions(sqlite3 *db){
     u8 needCollSeq;
     void (*xStep)(sqlite3_context*,int,sqlite3_value**);
     void (*xFinalize)(sqlite3_context*);
+    /* window function callbacks, or 0 */
+    void (*xValue)(sqlite3_context*);
+    void (*xInverse)(sqlite3_context*,int,sqlite3_value**);
   } aAggs[] = {
-    { "stdev",            1, 0, 0, varianceStep, stdevFinalize  },
-    { "variance",         1, 0, 0, varianceStep, varianceFinalize  },
-    { "mode",             1, 0, 0, modeStep,     modeFinalize  },
-    { "median",           1, 0, 0, modeStep,     medianFinalize  },
-    { "lower_quartile",   1, 0, 0, modeStep,     lower_quartileFinalize  },
-    { "upper_quartile",   1, 0, 0, modeStep,     upper_quartileFinalize  },
-    { "quantile",         2, 0, 0, modeStepArg,  quantileFinalize  },
+    { "stdev",            1, 0, 0, varianceStep, stdevFinalize, stdevFinalize, varianceInverse },
+    { "variance",         1, 0, 0, varianceStep, varianceFinalize, varianceFinalize, varianceInverse },
+    { "mode",             1, 0, 0, modeStep,     modeFinalize, 0, 0 },
+    { "median",           1, 0, 0, modeStep,     medianFinalize, medianValue, modeInverse },
+    { "lower_quartile",   1, 0, 0, modeStep,     lower_quartileFinalize, lower_quartileValue, modeInverse },
+    { "upper_quartile",   1, 0, 0, modeStep,     upper_quartileFinalize, upper_quartileValue, modeInverse },
+    { "quantile",         2, 0, 0, modeStepArg,  quantileFinalize, quantileValue, modeInverse },
+    { "summary",         -1, 0, 0, summaryStep,  summaryFinalize, 0, 0 },
+    { "approx_count_distinct", 1, 0, 0, hllStep, hllCountFinalize, 0, 0 },
+    { "approx_count_distinct", 2, 0, 0, hllStep, hllCountFinalize, 0, 0 },
+    { "hll",              1, 0, 0, hllStep,      hllFinalize, 0, 0 },
+    { "hll",              2, 0, 0, hllStep,      hllFinalize, 0, 0 },
+    { "hll_merge",        1, 0, 0, hllMergeStep, hllFinalize, 0, 0 },
   };
   unsigned int i;
 
@@ -1935,6 +2603,15 @@ int RegisterExtensionFunctions(sqlite3 *db){
     }
     //sqlite3CreateFunc
     /* LMH no error checking */
+#if SQLITE_VERSION_NUMBER >= 3025000
+    /* register as window function for use with OVER (ROWS ...) */
+    if( aAggs[i].xInverse ){
+      sqlite3_create_window_function(db, aAggs[i].zName, aAggs[i].nArg,
+          SQLITE_UTF8, pArg, aAggs[i].xStep, aAggs[i].xFinalize,
+          aAggs[i].xValue, aAggs[i].xInverse, 0);
+      continue;
+    }
+#endif
     sqlite3_create_function(db, aAggs[i].zName, aAggs[i].nArg, SQLITE_UTF8,
         pArg, 0, aAggs[i].xStep, aAggs[i].xFinalize);
 #if 0
@@ -1958,105 +2635,3 @@ int sqlite3_extension_init(
   return 0;
 }
 #endif /* COMPILE_SQLITE_EXTENSIONS_AS_LOADABLE_MODULE */
-
-map map_make(cmp_func cmp){
-  map r;
-  r.cmp=cmp;
-  r.base = 0;
-
-  return r;
-}
-
-void* xcalloc(size_t nmemb, size_t size, const char* /* s */){
-  void* ret = calloc(nmemb, size);
-  return ret;
-}
-
-void xfree(void* p){
-  free(p);
-}
-
-void node_insert(node** n, cmp_func cmp, void *e){
-  int c;
-  node* nn;
-  if(*n==0){
-    nn = (node*)xcalloc(1,sizeof(node), "for node");
-    nn->data = e;
-    nn->count = 1;
-    *n=nn;
-  }else{
-    c=cmp((*n)->data,e);
-    if(0==c){
-      ++((*n)->count);
-      xfree(e);
-    }else if(c>0){
-      /* put it right here */
-      node_insert(&((*n)->l), cmp, e);
-    }else{
-      node_insert(&((*n)->r), cmp, e);
-    }
-  }
-}
-
-void map_insert(map *m, void *e){
-  node_insert(&(m->base), m->cmp, e);
-}
-
-void node_iterate(node *n, map_iterator iter, void* p){
-  if(n){
-    if(n->l)
-      node_iterate(n->l, iter, p);
-    iter(n->data, n->count, p);
-    if(n->r)
-      node_iterate(n->r, iter, p);
-  }
-}
-
-void map_iterate(map *m, map_iterator iter, void* p){
-  node_iterate(m->base, iter, p);
-}
-
-void node_destroy(node *n){
-  if(0!=n){
-    xfree(n->data);
-    if(n->l)
-      node_destroy(n->l);
-    if(n->r)
-      node_destroy(n->r);
-
-    xfree(n);
-  }
-}
-
-void map_destroy(map *m){
-  node_destroy(m->base);
-}
-
-int int_cmp(const void *a, const void *b){
-  int64_t aa = *(int64_t *)(a);
-  int64_t bb = *(int64_t *)(b);
-  /* printf("cmp %d <=> %d\n",aa,bb); */
-  if(aa==bb)
-    return 0;
-  else if(aa<bb)
-    return -1;
-  else
-    return 1;
-}
-
-int double_cmp(const void *a, const void *b){
-  double aa = *(double *)(a);
-  double bb = *(double *)(b);
-  /* printf("cmp %d <=> %d\n",aa,bb); */
-  if(aa==bb)
-    return 0;
-  else if(aa<bb)
-    return -1;
-  else
-    return 1;
-}
-
-void print_elem(void *e, long long c, void* /* p */){
-  int ee = *(int*)(e);
-  printf("%d => %lld\n", ee,c);
-}
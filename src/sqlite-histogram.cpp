@@ -0,0 +1,367 @@
+/******************************************************************************
+ * src/sqlite-histogram.cpp
+ *
+ * Equi-width histograms for SQLite, computed in one streaming pass:
+ *
+ *   histogram(x, lo, hi, nbins)  -> blob of packed bin counts
+ *   histogram_bins(blob)         -> rows (bin_lo, bin_hi, count)
+ *
+ * Values in [lo,hi] are counted, hi falls into the last bin and all others
+ * are ignored. The table-valued function expands the blob for PLOT and
+ * MULTIPLOT, e.g.
+ *
+ *   SELECT (bin_lo + bin_hi) / 2 AS x, count AS y
+ *   FROM histogram_bins((SELECT histogram(time, 0, 100, 50) FROM stats))
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <sqlite3.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+//! maximum number of bins of a histogram
+static const sqlite3_int64 histogram_max_bins = 10000000;
+
+/******************************************************************************/
+// Packed Histogram
+
+//! Equi-width histogram, serialized as a blob of two doubles lo and hi,
+//! followed by the bin counts as 64-bit integers.
+struct Histogram
+{
+    //! range of the bins
+    double lo, hi;
+
+    //! counts of bins
+    std::vector<sqlite3_int64> counts;
+
+    //! count value x if it is in range
+    void add(double x)
+    {
+        if (!(x >= lo && x <= hi)) return;
+
+        size_t k = (size_t)((x - lo) / (hi - lo) * counts.size());
+        if (k >= counts.size()) k = counts.size() - 1;
+
+        ++counts[k];
+    }
+
+    //! lower boundary of bin i
+    double bin_lo(size_t i) const
+    {
+        return lo + (hi - lo) * i / counts.size();
+    }
+
+    //! upper boundary of bin i
+    double bin_hi(size_t i) const
+    {
+        if (i + 1 == counts.size()) return hi;
+        return lo + (hi - lo) * (i + 1) / counts.size();
+    }
+
+    //! serialize to a blob
+    std::string serialize() const
+    {
+        std::string out(2 * sizeof(double)
+                        + counts.size() * sizeof(sqlite3_int64), 0);
+
+        memcpy(&out[0], &lo, sizeof(double));
+        memcpy(&out[sizeof(double)], &hi, sizeof(double));
+        memcpy(&out[2 * sizeof(double)], counts.data(),
+               counts.size() * sizeof(sqlite3_int64));
+
+        return out;
+    }
+
+    //! deserialize from blob, returns false if malformed
+    bool deserialize(const void* data, size_t size)
+    {
+        const size_t hsize = 2 * sizeof(double);
+        if (size <= hsize || (size - hsize) % sizeof(sqlite3_int64) != 0)
+            return false;
+
+        const char* p = (const char*)data;
+        memcpy(&lo, p, sizeof(double));
+        memcpy(&hi, p + sizeof(double), sizeof(double));
+        if (!(lo < hi)) return false;
+
+        counts.resize((size - hsize) / sizeof(sqlite3_int64));
+        memcpy(counts.data(), p + hsize, size - hsize);
+        return true;
+    }
+};
+
+/******************************************************************************/
+// Aggregate Function
+
+//! aggregate context: histogram allocated with parameters of the first row
+struct HistogramCtx
+{
+    Histogram* hist;
+};
+
+//! xStep of histogram(x, lo, hi, nbins)
+static void
+histogram_step(sqlite3_context* ctx, int /* argc */, sqlite3_value** argv)
+{
+    HistogramCtx* p = (HistogramCtx*)sqlite3_aggregate_context(ctx, sizeof(*p));
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    if (!p->hist)
+    {
+        double lo = sqlite3_value_double(argv[1]);
+        double hi = sqlite3_value_double(argv[2]);
+        sqlite3_int64 nbins = sqlite3_value_int64(argv[3]);
+
+        if (!(lo < hi))
+            return sqlite3_result_error(ctx, "histogram: lo must be less than hi", -1);
+        if (nbins < 1 || nbins > histogram_max_bins)
+            return sqlite3_result_error(ctx, "histogram: invalid number of bins", -1);
+
+        p->hist = new Histogram;
+        p->hist->lo = lo;
+        p->hist->hi = hi;
+        p->hist->counts.resize(nbins, 0);
+    }
+
+    if (sqlite3_value_numeric_type(argv[0]) == SQLITE_NULL) return;
+
+    p->hist->add(sqlite3_value_double(argv[0]));
+}
+
+//! xFinal of histogram(): return packed bins, NULL for no rows
+static void
+histogram_final(sqlite3_context* ctx)
+{
+    HistogramCtx* p = (HistogramCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->hist) return;
+
+    std::string blob = p->hist->serialize();
+    sqlite3_result_blob(ctx, blob.data(), blob.size(), SQLITE_TRANSIENT);
+
+    delete p->hist;
+    p->hist = NULL;
+}
+
+/******************************************************************************/
+// Table-Valued Function histogram_bins(blob)
+
+//! columns of histogram_bins
+enum {
+    HISTOGRAM_BIN_LO, HISTOGRAM_BIN_HI, HISTOGRAM_COUNT, HISTOGRAM_HIST
+};
+
+//! Virtual table cursor
+struct HistogramCursor
+{
+    //! SQLite base class, must be first
+    sqlite3_vtab_cursor base;
+
+    //! expanded histogram, no bins if the argument is NULL or malformed
+    Histogram hist;
+
+    //! current bin
+    size_t bin;
+};
+
+//! xConnect of eponymous virtual table
+static int
+histogram_bins_connect(sqlite3* db, void* /* pAux */,
+                       int /* argc */, const char* const* /* argv */,
+                       sqlite3_vtab** ppVtab, char** /* pzErr */)
+{
+    int rc = sqlite3_declare_vtab(
+        db, "CREATE TABLE x(bin_lo REAL, bin_hi REAL, count INTEGER, "
+        "hist HIDDEN)");
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_vtab* tab = new sqlite3_vtab;
+    memset(tab, 0, sizeof(*tab));
+
+    *ppVtab = tab;
+    return SQLITE_OK;
+}
+
+//! xDisconnect
+static int
+histogram_bins_disconnect(sqlite3_vtab* vtab)
+{
+    delete vtab;
+    return SQLITE_OK;
+}
+
+//! xBestIndex: the hidden argument column must be given
+static int
+histogram_bins_best_index(sqlite3_vtab* /* vtab */, sqlite3_index_info* info)
+{
+    for (int i = 0; i < info->nConstraint; ++i)
+    {
+        const sqlite3_index_info::sqlite3_index_constraint& c =
+            info->aConstraint[i];
+
+        if (c.iColumn != HISTOGRAM_HIST || c.op != SQLITE_INDEX_CONSTRAINT_EQ)
+            continue;
+
+        if (!c.usable) return SQLITE_CONSTRAINT;
+
+        info->aConstraintUsage[i].argvIndex = 1;
+        info->aConstraintUsage[i].omit = 1;
+        info->idxNum = 1;
+        info->estimatedCost = 100;
+        return SQLITE_OK;
+    }
+
+    // no argument: empty table
+    info->idxNum = 0;
+    info->estimatedCost = 1e9;
+    return SQLITE_OK;
+}
+
+//! xOpen
+static int
+histogram_bins_open(sqlite3_vtab* /* vtab */, sqlite3_vtab_cursor** ppCursor)
+{
+    HistogramCursor* cur = new HistogramCursor;
+    memset(&cur->base, 0, sizeof(cur->base));
+    cur->bin = 0;
+
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+//! xClose
+static int
+histogram_bins_close(sqlite3_vtab_cursor* cursor)
+{
+    delete (HistogramCursor*)cursor;
+    return SQLITE_OK;
+}
+
+//! xFilter: unpack the histogram blob
+static int
+histogram_bins_filter(sqlite3_vtab_cursor* cursor, int idxNum,
+                      const char* /* idxStr */, int /* argc */,
+                      sqlite3_value** argv)
+{
+    HistogramCursor* cur = (HistogramCursor*)cursor;
+
+    cur->hist.counts.clear();
+    cur->bin = 0;
+
+    if (idxNum != 1 || sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return SQLITE_OK;
+
+    if (!cur->hist.deserialize(sqlite3_value_blob(argv[0]),
+                               sqlite3_value_bytes(argv[0])))
+    {
+        sqlite3_vtab* tab = cursor->pVtab;
+        sqlite3_free(tab->zErrMsg);
+        tab->zErrMsg = sqlite3_mprintf("histogram_bins: invalid histogram");
+        return SQLITE_ERROR;
+    }
+
+    return SQLITE_OK;
+}
+
+//! xNext
+static int
+histogram_bins_next(sqlite3_vtab_cursor* cursor)
+{
+    ++((HistogramCursor*)cursor)->bin;
+    return SQLITE_OK;
+}
+
+//! xEof
+static int
+histogram_bins_eof(sqlite3_vtab_cursor* cursor)
+{
+    HistogramCursor* cur = (HistogramCursor*)cursor;
+    return cur->bin >= cur->hist.counts.size();
+}
+
+//! xColumn
+static int
+histogram_bins_column(sqlite3_vtab_cursor* cursor, sqlite3_context* ctx,
+                      int col)
+{
+    HistogramCursor* cur = (HistogramCursor*)cursor;
+
+    switch (col)
+    {
+    case HISTOGRAM_BIN_LO:
+        sqlite3_result_double(ctx, cur->hist.bin_lo(cur->bin));
+        break;
+    case HISTOGRAM_BIN_HI:
+        sqlite3_result_double(ctx, cur->hist.bin_hi(cur->bin));
+        break;
+    case HISTOGRAM_COUNT:
+        sqlite3_result_int64(ctx, cur->hist.counts[cur->bin]);
+        break;
+    default:
+        sqlite3_result_null(ctx);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+//! xRowid
+static int
+histogram_bins_rowid(sqlite3_vtab_cursor* cursor, sqlite3_int64* pRowid)
+{
+    *pRowid = ((HistogramCursor*)cursor)->bin;
+    return SQLITE_OK;
+}
+
+//! method table of the eponymous-only read-only histogram_bins module
+static sqlite3_module
+histogram_bins_module()
+{
+    // further methods are NULL
+    sqlite3_module module;
+    memset(&module, 0, sizeof(module));
+
+    module.iVersion = 0;
+    module.xConnect = histogram_bins_connect;
+    module.xBestIndex = histogram_bins_best_index;
+    module.xDisconnect = histogram_bins_disconnect;
+    module.xOpen = histogram_bins_open;
+    module.xClose = histogram_bins_close;
+    module.xFilter = histogram_bins_filter;
+    module.xNext = histogram_bins_next;
+    module.xEof = histogram_bins_eof;
+    module.xColumn = histogram_bins_column;
+    module.xRowid = histogram_bins_rowid;
+
+    return module;
+}
+
+//! register histogram() and histogram_bins() with the database connection
+int RegisterHistogramFunctions(sqlite3* db)
+{
+    int rc = sqlite3_create_function(db, "histogram", 4, SQLITE_UTF8, NULL,
+                                     NULL, histogram_step, histogram_final);
+    if (rc != SQLITE_OK) return rc;
+
+    // initialized once, also when sessions connect concurrently
+    static const sqlite3_module module = histogram_bins_module();
+
+    return sqlite3_create_module(db, "histogram_bins", &module, NULL);
+}
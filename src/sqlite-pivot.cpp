@@ -0,0 +1,468 @@
+/******************************************************************************
+ * src/sqlite-pivot.cpp
+ *
+ * SQLite virtual table module "pivot", which turns a long table into a wide
+ * crosstab in one hash-aggregation pass:
+ *
+ *   CREATE VIRTUAL TABLE temp.p USING pivot(stats, size, algo, time, avg)
+ *
+ * The table has one row per distinct size and one column per distinct algo
+ * containing the aggregated time. The source may also be a subquery in
+ * parentheses, the aggregate is one of count, sum, avg (default), min or max.
+ *
+ * The value columns are determined when the table is created and ordered by
+ * their key, rows are returned in order of first appearance, use ORDER BY to
+ * sort them. The data itself is aggregated anew by each scan.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <sqlite3.h>
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "strtools.h"
+
+//! aggregates available for the pivot cells
+enum PivotAgg { PIVOT_COUNT, PIVOT_SUM, PIVOT_AVG, PIVOT_MIN, PIVOT_MAX };
+
+//! Aggregated value of one cell
+struct PivotCell
+{
+    //! number of non-NULL values
+    sqlite3_int64 count;
+
+    //! sum as integer while all values are integers
+    sqlite3_int64 isum;
+    bool isint;
+
+    //! sum, minimum and maximum as double
+    double sum, min, max;
+
+    PivotCell()
+        : count(0), isum(0), isint(true), sum(0), min(0), max(0)
+    { }
+
+    //! add a numeric value
+    void add(sqlite3_value* v)
+    {
+        int type = sqlite3_value_numeric_type(v);
+        if (type == SQLITE_NULL) return;
+
+        double d = sqlite3_value_double(v);
+
+        if (type == SQLITE_INTEGER && isint)
+            isum += sqlite3_value_int64(v);
+        else
+            isint = false;
+
+        if (count == 0 || d < min) min = d;
+        if (count == 0 || d > max) max = d;
+        sum += d;
+        ++count;
+    }
+
+    //! output aggregate result
+    void result(sqlite3_context* ctx, PivotAgg agg) const
+    {
+        if (agg == PIVOT_COUNT)
+            return sqlite3_result_int64(ctx, count);
+
+        if (count == 0)
+            return sqlite3_result_null(ctx);
+
+        switch (agg)
+        {
+        case PIVOT_SUM:
+            if (isint) sqlite3_result_int64(ctx, isum);
+            else sqlite3_result_double(ctx, sum);
+            break;
+        case PIVOT_AVG:
+            sqlite3_result_double(ctx, sum / count);
+            break;
+        case PIVOT_MIN:
+            if (isint) sqlite3_result_int64(ctx, (sqlite3_int64)min);
+            else sqlite3_result_double(ctx, min);
+            break;
+        case PIVOT_MAX:
+            if (isint) sqlite3_result_int64(ctx, (sqlite3_int64)max);
+            else sqlite3_result_double(ctx, max);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+//! serialize a key value for hashing, numbers equal in SQL map to the same
+//! string.
+static inline std::string
+pivot_key(sqlite3_value* v)
+{
+    switch (sqlite3_value_type(v))
+    {
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT: {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "n%.17g", sqlite3_value_double(v));
+        return buf;
+    }
+    case SQLITE_TEXT:
+        return 't' + std::string((const char*)sqlite3_value_text(v),
+                                 sqlite3_value_bytes(v));
+    case SQLITE_BLOB:
+        return 'b' + std::string((const char*)sqlite3_value_blob(v),
+                                 sqlite3_value_bytes(v));
+    default:
+        return "z";
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! Virtual table object
+struct PivotTable
+{
+    //! SQLite base class, must be first
+    sqlite3_vtab base;
+
+    //! database connection to scan source
+    sqlite3* db;
+
+    //! query returning row key, column key and value
+    std::string query;
+
+    //! aggregate of cells
+    PivotAgg agg;
+
+    //! map of column key to value column index
+    std::unordered_map<std::string, size_t> columns;
+};
+
+//! One row of the pivot table
+struct PivotRow
+{
+    //! row key value
+    sqlite3_value* key;
+
+    //! cells of value columns
+    std::vector<PivotCell> cells;
+};
+
+//! Virtual table cursor
+struct PivotCursor
+{
+    //! SQLite base class, must be first
+    sqlite3_vtab_cursor base;
+
+    //! aggregated rows in order of first appearance
+    std::vector<PivotRow> rows;
+
+    //! current row
+    size_t row;
+
+    //! free row key values
+    void clear()
+    {
+        for (size_t i = 0; i < rows.size(); ++i)
+            sqlite3_value_free(rows[i].key);
+        rows.clear();
+    }
+};
+
+//! strip SQL quotes from a module argument
+static inline std::string
+pivot_unquote(const std::string& arg)
+{
+    std::string str = trim(arg);
+    if (str.size() >= 2 && (str[0] == '\'' || str[0] == '"') &&
+        str[str.size()-1] == str[0])
+    {
+        str = str.substr(1, str.size() - 2);
+    }
+    return str;
+}
+
+//! quote an identifier for a column declaration
+static inline std::string
+pivot_quote_ident(const std::string& str)
+{
+    return '"' + replace_all(str, "\"", "\"\"") + '"';
+}
+
+//! xCreate and xConnect: determine value columns and declare table
+static int
+pivot_connect(sqlite3* db, void* /* pAux */,
+              int argc, const char* const* argv,
+              sqlite3_vtab** ppVtab, char** pzErr)
+{
+    PivotTable* tab = new PivotTable;
+    memset(&tab->base, 0, sizeof(tab->base));
+    tab->db = db;
+    tab->agg = PIVOT_AVG;
+
+    sqlite3_stmt* stmt = NULL;
+
+    try
+    {
+        // argv[0..2] are module, database and table name
+        if (argc != 7 && argc != 8)
+            OUT_THROW("pivot: expected arguments (source, row_key, col_key, "
+                      "value [, aggregate])");
+
+        std::string source = trim(argv[3]);
+        std::string row_key = trim(argv[4]);
+        std::string col_key = trim(argv[5]);
+        std::string value = trim(argv[6]);
+
+        if (argc == 8)
+        {
+            std::string agg = str_tolower(pivot_unquote(argv[7]));
+            if (agg == "count") tab->agg = PIVOT_COUNT;
+            else if (agg == "sum") tab->agg = PIVOT_SUM;
+            else if (agg == "avg") tab->agg = PIVOT_AVG;
+            else if (agg == "min") tab->agg = PIVOT_MIN;
+            else if (agg == "max") tab->agg = PIVOT_MAX;
+            else
+                OUT_THROW("pivot: unknown aggregate '" << agg << "', use one "
+                          "of count, sum, avg, min or max.");
+        }
+
+        tab->query = "SELECT " + row_key + ", " + col_key + ", " + value +
+                     " FROM " + source;
+
+        // determine value columns in order of their keys, the key is aliased
+        // in a subquery such that a source column k does not hide it
+        std::string cquery = "SELECT DISTINCT k FROM (SELECT " + col_key +
+                             " AS k FROM " + source +
+                             ") WHERE k IS NOT NULL ORDER BY k";
+
+        if (sqlite3_prepare_v2(db, cquery.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+            OUT_THROW("pivot: " << sqlite3_errmsg(db));
+
+        std::ostringstream decl;
+        decl << "CREATE TABLE x (" << pivot_quote_ident(pivot_unquote(row_key));
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            std::string key = pivot_key(sqlite3_column_value(stmt, 0));
+            tab->columns.insert(std::make_pair(key, tab->columns.size()));
+
+            decl << ", " << pivot_quote_ident(
+                (const char*)sqlite3_column_text(stmt, 0));
+        }
+        decl << ")";
+
+        if (rc != SQLITE_DONE)
+            OUT_THROW("pivot: " << sqlite3_errmsg(db));
+
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+
+        if (sqlite3_declare_vtab(db, decl.str().c_str()) != SQLITE_OK)
+            OUT_THROW("pivot: " << sqlite3_errmsg(db));
+    }
+    catch (std::runtime_error& e)
+    {
+        *pzErr = sqlite3_mprintf("%s", e.what());
+        sqlite3_finalize(stmt);
+        delete tab;
+        return SQLITE_ERROR;
+    }
+
+    *ppVtab = &tab->base;
+    return SQLITE_OK;
+}
+
+//! xDisconnect and xDestroy
+static int
+pivot_disconnect(sqlite3_vtab* vtab)
+{
+    delete (PivotTable*)vtab;
+    return SQLITE_OK;
+}
+
+//! xBestIndex: always a full scan of the source
+static int
+pivot_best_index(sqlite3_vtab* /* vtab */, sqlite3_index_info* info)
+{
+    info->estimatedCost = 1e6;
+    return SQLITE_OK;
+}
+
+//! xOpen
+static int
+pivot_open(sqlite3_vtab* /* vtab */, sqlite3_vtab_cursor** ppCursor)
+{
+    PivotCursor* cur = new PivotCursor;
+    memset(&cur->base, 0, sizeof(cur->base));
+    cur->row = 0;
+
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+//! xClose
+static int
+pivot_close(sqlite3_vtab_cursor* cursor)
+{
+    PivotCursor* cur = (PivotCursor*)cursor;
+    cur->clear();
+    delete cur;
+    return SQLITE_OK;
+}
+
+//! xFilter: aggregate source in one pass into rows keyed by a hash map
+static int
+pivot_filter(sqlite3_vtab_cursor* cursor, int /* idxNum */,
+             const char* /* idxStr */, int /* argc */,
+             sqlite3_value** /* argv */)
+{
+    PivotCursor* cur = (PivotCursor*)cursor;
+    PivotTable* tab = (PivotTable*)cursor->pVtab;
+
+    cur->clear();
+    cur->row = 0;
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(tab->db, tab->query.c_str(), -1, &stmt, NULL)
+        != SQLITE_OK)
+    {
+        sqlite3_free(tab->base.zErrMsg);
+        tab->base.zErrMsg = sqlite3_mprintf("pivot: %s", sqlite3_errmsg(tab->db));
+        return SQLITE_ERROR;
+    }
+
+    std::unordered_map<std::string, size_t> rowmap;
+    std::unordered_map<std::string, size_t>::const_iterator ci;
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        // value columns added after creating the table are ignored
+        ci = tab->columns.find(pivot_key(sqlite3_column_value(stmt, 1)));
+        if (ci == tab->columns.end()) continue;
+
+        sqlite3_value* rkey = sqlite3_column_value(stmt, 0);
+
+        std::pair<std::unordered_map<std::string, size_t>::iterator, bool> ri =
+            rowmap.insert(std::make_pair(pivot_key(rkey), cur->rows.size()));
+
+        if (ri.second)
+        {
+            cur->rows.push_back(PivotRow());
+            cur->rows.back().key = sqlite3_value_dup(rkey);
+            cur->rows.back().cells.resize(tab->columns.size());
+        }
+
+        cur->rows[ri.first->second].cells[ci->second].add(
+            sqlite3_column_value(stmt, 2));
+    }
+
+    if (rc != SQLITE_DONE)
+    {
+        sqlite3_free(tab->base.zErrMsg);
+        tab->base.zErrMsg = sqlite3_mprintf("pivot: %s", sqlite3_errmsg(tab->db));
+        sqlite3_finalize(stmt);
+        return SQLITE_ERROR;
+    }
+
+    sqlite3_finalize(stmt);
+    return SQLITE_OK;
+}
+
+//! xNext
+static int
+pivot_next(sqlite3_vtab_cursor* cursor)
+{
+    ++((PivotCursor*)cursor)->row;
+    return SQLITE_OK;
+}
+
+//! xEof
+static int
+pivot_eof(sqlite3_vtab_cursor* cursor)
+{
+    PivotCursor* cur = (PivotCursor*)cursor;
+    return cur->row >= cur->rows.size();
+}
+
+//! xColumn: row key or aggregated cell
+static int
+pivot_column(sqlite3_vtab_cursor* cursor, sqlite3_context* ctx, int col)
+{
+    PivotCursor* cur = (PivotCursor*)cursor;
+    PivotTable* tab = (PivotTable*)cursor->pVtab;
+
+    const PivotRow& row = cur->rows[cur->row];
+
+    if (col == 0)
+        sqlite3_result_value(ctx, row.key);
+    else
+        row.cells[col - 1].result(ctx, tab->agg);
+
+    return SQLITE_OK;
+}
+
+//! xRowid
+static int
+pivot_rowid(sqlite3_vtab_cursor* cursor, sqlite3_int64* pRowid)
+{
+    *pRowid = ((PivotCursor*)cursor)->row;
+    return SQLITE_OK;
+}
+
+//! method table of the read-only pivot module
+static sqlite3_module
+pivot_module()
+{
+    // further methods are NULL
+    sqlite3_module module;
+    memset(&module, 0, sizeof(module));
+
+    module.iVersion = 0;
+    module.xCreate = pivot_connect;
+    module.xConnect = pivot_connect;
+    module.xBestIndex = pivot_best_index;
+    module.xDisconnect = pivot_disconnect;
+    module.xDestroy = pivot_disconnect;
+    module.xOpen = pivot_open;
+    module.xClose = pivot_close;
+    module.xFilter = pivot_filter;
+    module.xNext = pivot_next;
+    module.xEof = pivot_eof;
+    module.xColumn = pivot_column;
+    module.xRowid = pivot_rowid;
+
+    return module;
+}
+
+//! register virtual table module "pivot" with the database connection
+int RegisterPivotModule(sqlite3* db)
+{
+    // initialized once, also when sessions connect concurrently
+    static const sqlite3_module module = pivot_module();
+
+    return sqlite3_create_module(db, "pivot", &module, NULL);
+}
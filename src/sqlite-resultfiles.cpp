@@ -0,0 +1,733 @@
+/******************************************************************************
+ * src/sqlite-resultfiles.cpp
+ *
+ * SQLite virtual table module "resultfiles", which queries RESULT files in
+ * place without importing them:
+ *
+ *   CREATE VIRTUAL TABLE t USING resultfiles('logs/run*.txt.gz', 'more.txt')
+ *
+ * CREATE reads all files once to detect the columns and their types like
+ * IMPORT-DATA does, keeping only the fields. Rows are parsed lazily during a
+ * scan and cached until the file changes, up to a memory limit.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <sqlite3.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include "common.h"
+#include "strtools.h"
+#include "simpleglob.h"
+#include "importdata.h"
+
+//! Parsed form of one RESULT file.
+struct ResultFileData
+{
+    //! cell of a row: present flag and value
+    typedef std::pair<bool, std::string> cell_type;
+
+    //! row of cells, indexed like fieldset
+    typedef std::vector<cell_type> row_type;
+
+    //! modification time of parsed file
+    time_t mtime;
+
+    //! size of parsed file
+    off_t size;
+
+    //! fields in order of appearance with detected types
+    FieldSet fieldset;
+
+    //! rows of file, empty if only the fields were detected
+    std::vector<row_type> rows;
+
+    //! approximate memory used by rows
+    size_t bytes;
+
+    ResultFileData()
+        : mtime(0), size(0), bytes(0)
+    {
+    }
+};
+
+//! ImportData derivative, which collects the key=value rows of a file
+//! instead of inserting them into a table.
+class ResultFileParser : public ImportData
+{
+protected:
+    //! output data
+    ResultFileData& m_data;
+
+    //! field keys in order of appearance
+    std::vector<std::string> m_keys;
+
+    //! detected type of each key
+    std::vector<FieldSet::fieldtype> m_types;
+
+    //! map of key to index in m_keys
+    std::map<std::string, unsigned int> m_keyindex;
+
+    //! whether to collect rows or only detect fields
+    bool m_keep_rows;
+
+public:
+    ResultFileParser(ResultFileData& data, bool keep_rows)
+        : m_data(data), m_keep_rows(keep_rows)
+    {
+    }
+
+    //! process a line: split into cells of a row.
+    bool process_line(const std::string& line)
+    {
+        if (!mopt_all_lines && is_result_line(line) == 0)
+            return true;
+
+        slist_type slist = split_result_line(line);
+
+        std::set<std::string> keyset;
+        ResultFileData::row_type row;
+
+        for (size_t col = 0; col < slist.size(); ++col)
+        {
+            if (slist[col].size() == 0) return true;
+
+            std::string key, value;
+            split_keyvalue(slist[col], col, key, value);
+            key = dedup_key(key, keyset);
+
+            FieldSet::fieldtype t = FieldSet::detect(value);
+
+            std::map<std::string, unsigned int>::iterator ki =
+                m_keyindex.find(key);
+
+            unsigned int idx;
+            if (ki == m_keyindex.end()) {
+                idx = m_keys.size();
+                m_keyindex[key] = idx;
+                m_keys.push_back(key);
+                m_types.push_back(t);
+            }
+            else {
+                idx = ki->second;
+                if (m_types[idx] > t) m_types[idx] = t;
+            }
+
+            if (!m_keep_rows) continue;
+
+            if (row.size() <= idx) row.resize(idx + 1);
+            row[idx] = ResultFileData::cell_type(true, value);
+            m_data.bytes += value.size();
+        }
+
+        if (m_keep_rows) {
+            m_data.bytes += sizeof(row) +
+                row.capacity() * sizeof(ResultFileData::cell_type);
+            m_data.rows.push_back(row);
+        }
+        ++m_count, ++m_total_count;
+
+        return true;
+    }
+
+    //! store detected fields
+    void finish()
+    {
+        for (size_t i = 0; i < m_keys.size(); ++i)
+            m_data.fieldset.add_field(m_keys[i], m_types[i]);
+    }
+};
+
+//! maximum approximate memory used by cached rows of parsed files
+static const size_t resultfile_cache_limit = 256 * 1024 * 1024;
+
+//! cached forms of a file
+struct ResultFileCacheEntry
+{
+    //! modification time and size of the cached file
+    time_t mtime;
+    off_t size;
+
+    //! detected fields only
+    boost::shared_ptr<ResultFileData> fields;
+
+    //! fields and rows, NULL if not parsed or evicted
+    boost::shared_ptr<ResultFileData> rows;
+
+    //! last use of rows, the least recently used are evicted first
+    unsigned long long used;
+    ResultFileCacheEntry()
+        : mtime(0), size(0), used(0)
+    {
+    }
+};
+
+//! cache of parsed files
+static std::map<std::string, ResultFileCacheEntry> s_resultfile_cache;
+
+//! memory used by the cached rows
+static size_t s_resultfile_bytes = 0;
+
+//! counter for the last use of cached rows
+static unsigned long long s_resultfile_clock = 0;
+
+//! lock for the cache, used by connection pool threads
+static std::mutex s_resultfile_mutex;
+
+//! return the cache entry of a file, cleared if the file changed. Must be
+//! called with s_resultfile_mutex held.
+static ResultFileCacheEntry&
+resultfile_entry(const std::string& fname)
+{
+    struct stat st;
+    if (stat(fname.c_str(), &st) != 0)
+        OUT_THROW("Error reading " << fname << ": " << strerror(errno));
+
+    ResultFileCacheEntry& entry = s_resultfile_cache[fname];
+
+    if (entry.mtime != st.st_mtime || entry.size != st.st_size)
+    {
+        if (entry.rows) s_resultfile_bytes -= entry.rows->bytes;
+        entry.rows.reset();
+        entry.fields.reset();
+        entry.mtime = st.st_mtime;
+        entry.size = st.st_size;
+    }
+
+    return entry;
+}
+
+//! parse a file into new data
+static boost::shared_ptr<ResultFileData>
+resultfile_parse(const std::string& fname, const ResultFileCacheEntry& entry,
+                 bool keep_rows)
+{
+    boost::shared_ptr<ResultFileData> data(new ResultFileData);
+    data->mtime = entry.mtime;
+    data->size = entry.size;
+
+    ResultFileParser parser(*data, keep_rows);
+    parser.process_file(fname);
+    parser.finish();
+
+    return data;
+}
+
+//! return the detected fields of a file, without keeping its rows
+static boost::shared_ptr<ResultFileData>
+resultfile_fields(const std::string& fname)
+{
+    std::unique_lock<std::mutex> lock(s_resultfile_mutex);
+
+    ResultFileCacheEntry& entry = resultfile_entry(fname);
+
+    if (!entry.fields)
+        entry.fields = resultfile_parse(fname, entry, false);
+
+    return entry.fields;
+}
+
+//! return parsed form of a file with its rows, from the cache if unchanged.
+//! Evicts the least recently used rows of other files above the cache limit.
+static boost::shared_ptr<ResultFileData>
+resultfile_load(const std::string& fname)
+{
+    std::unique_lock<std::mutex> lock(s_resultfile_mutex);
+
+    ResultFileCacheEntry& entry = resultfile_entry(fname);
+    entry.used = ++s_resultfile_clock;
+
+    if (entry.rows)
+        return entry.rows;
+
+    entry.rows = resultfile_parse(fname, entry, true);
+    s_resultfile_bytes += entry.rows->bytes;
+
+    while (s_resultfile_bytes > resultfile_cache_limit)
+    {
+        ResultFileCacheEntry* lru = NULL;
+
+        for (std::map<std::string, ResultFileCacheEntry>::iterator it =
+                 s_resultfile_cache.begin(); it != s_resultfile_cache.end(); ++it)
+        {
+            ResultFileCacheEntry& e = it->second;
+            if (e.rows && &e != &entry && (!lru || e.used < lru->used))
+                lru = &e;
+        }
+
+        if (!lru) break;
+
+        // cursors still scanning the rows keep them alive
+        s_resultfile_bytes -= lru->rows->bytes;
+        lru->rows.reset();
+    }
+
+    return entry.rows;
+}
+
+//! parse a complete string as integer
+static inline bool
+resultfile_int64(const std::string& str, sqlite3_int64& out)
+{
+    if (str.empty()) return false;
+    char* endp;
+    errno = 0;
+    out = strtoll(str.c_str(), &endp, 10);
+    return (*endp == 0 && errno == 0);
+}
+
+//! parse a complete string as double
+static inline bool
+resultfile_double(const std::string& str, double& out)
+{
+    if (str.empty()) return false;
+    char* endp;
+    out = strtod(str.c_str(), &endp);
+    return (*endp == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! Virtual table object
+struct ResultFilesTable
+{
+    //! SQLite base class, must be first
+    sqlite3_vtab base;
+
+    //! matching files
+    std::vector<std::string> files;
+
+    //! columns of virtual table
+    FieldSet fieldset;
+};
+
+//! Equality constraint passed to the scanner
+struct ResultFilesConstraint
+{
+    //! table column
+    int col;
+
+    //! SQLite value type
+    int type;
+
+    //! value as integer, double and text
+    sqlite3_int64 ival;
+    double dval;
+    std::string text;
+};
+
+//! Virtual table cursor
+struct ResultFilesCursor
+{
+    //! SQLite base class, must be first
+    sqlite3_vtab_cursor base;
+
+    //! equality constraints
+    std::vector<ResultFilesConstraint> constraints;
+
+    //! index of current file
+    size_t file;
+
+    //! parsed current file
+    boost::shared_ptr<ResultFileData> data;
+
+    //! map of table columns to field index in current file, or -1
+    std::vector<int> colmap;
+
+    //! current row in file
+    size_t row;
+
+    //! running row id
+    sqlite3_int64 rowid;
+};
+
+//! check whether a row can satisfy all equality constraints. Rows are only
+//! rejected when SQLite's own comparison would fail for certain, as it
+//! checks the constraints again.
+static inline bool
+resultfiles_match(const ResultFilesTable* tab, const ResultFilesCursor* cur,
+                  const ResultFileData::row_type& row)
+{
+    for (size_t i = 0; i < cur->constraints.size(); ++i)
+    {
+        const ResultFilesConstraint& c = cur->constraints[i];
+
+        int k = cur->colmap[c.col];
+        if (k < 0 || k >= (int)row.size() || !row[k].first)
+            return false; // NULL never equals anything
+
+        if (c.type == SQLITE_NULL) return false;
+
+        const std::string& cell = row[k].second;
+
+        if (tab->fieldset.type(c.col) == FieldSet::T_VARCHAR)
+        {
+            if (cell != c.text) return false;
+        }
+        else if (c.type == SQLITE_INTEGER)
+        {
+            sqlite3_int64 ival;
+            double dval;
+            if (resultfile_int64(cell, ival)) {
+                if (ival != c.ival) return false;
+            }
+            else if (resultfile_double(cell, dval)) {
+                if (dval != c.dval) return false;
+            }
+        }
+        else if (c.type == SQLITE_FLOAT)
+        {
+            double dval;
+            if (resultfile_double(cell, dval) && dval != c.dval)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+//! advance cursor to the next matching row, beginning at the given row of the
+//! current file and loading following files lazily.
+static void
+resultfiles_seek(ResultFilesTable* tab, ResultFilesCursor* cur, size_t row)
+{
+    while (cur->file < tab->files.size())
+    {
+        if (!cur->data)
+        {
+            cur->data = resultfile_load(tab->files[cur->file]);
+
+            // map table columns to the file's fields
+            const FieldSet& fs = cur->data->fieldset;
+            std::map<std::string, int> index;
+            for (size_t i = 0; i < fs.count(); ++i)
+                index[fs.key(i)] = i;
+
+            cur->colmap.assign(tab->fieldset.count(), -1);
+            for (size_t c = 0; c < tab->fieldset.count(); ++c)
+            {
+                std::map<std::string, int>::const_iterator it =
+                    index.find(tab->fieldset.key(c));
+                if (it != index.end()) cur->colmap[c] = it->second;
+            }
+
+            row = 0;
+        }
+
+        for ( ; row < cur->data->rows.size(); ++row)
+        {
+            if (resultfiles_match(tab, cur, cur->data->rows[row])) {
+                cur->row = row;
+                return;
+            }
+        }
+
+        cur->data.reset();
+        ++cur->file;
+    }
+}
+
+//! strip SQL quotes from a module argument
+static inline std::string
+resultfiles_unquote(const std::string& arg)
+{
+    std::string str = trim(arg);
+    if (str.size() >= 2 && (str[0] == '\'' || str[0] == '"') &&
+        str[str.size()-1] == str[0])
+    {
+        str = str.substr(1, str.size() - 2);
+    }
+    return str;
+}
+
+//! xCreate and xConnect: glob files and declare columns
+static int
+resultfiles_connect(sqlite3* db, void* /* pAux */,
+                    int argc, const char* const* argv,
+                    sqlite3_vtab** ppVtab, char** pzErr)
+{
+    ResultFilesTable* tab = new ResultFilesTable;
+    memset(&tab->base, 0, sizeof(tab->base));
+
+    try
+    {
+        // argv[0..2] are module, database and table name
+        CSimpleGlob glob(SG_GLOB_ONLYFILE | SG_GLOB_TILDE);
+
+        for (int i = 3; i < argc; ++i)
+        {
+            std::string pattern = resultfiles_unquote(argv[i]);
+            if (glob.Add(pattern.c_str()) != SG_SUCCESS)
+                OUT_THROW("resultfiles: error while globbing " << pattern);
+        }
+
+        for (int fi = 0; fi < glob.FileCount(); ++fi)
+        {
+            tab->files.push_back(glob.File(fi));
+
+            boost::shared_ptr<ResultFileData> data =
+                resultfile_fields(tab->files.back());
+            tab->fieldset.add_fields(data->fieldset);
+        }
+
+        if (tab->fieldset.count() == 0)
+            OUT_THROW("resultfiles: no RESULT lines found in files.");
+
+        std::ostringstream decl;
+        decl << "CREATE TABLE x (";
+        for (size_t c = 0; c < tab->fieldset.count(); ++c)
+        {
+            if (c != 0) decl << ", ";
+            decl << '"' << tab->fieldset.key(c) << "\" "
+                 << FieldSet::sqlname(tab->fieldset.type(c));
+        }
+        decl << ")";
+
+        int rc = sqlite3_declare_vtab(db, decl.str().c_str());
+        if (rc != SQLITE_OK)
+            OUT_THROW("resultfiles: " << sqlite3_errmsg(db));
+    }
+    catch (std::runtime_error& e)
+    {
+        *pzErr = sqlite3_mprintf("%s", e.what());
+        delete tab;
+        return SQLITE_ERROR;
+    }
+
+    *ppVtab = &tab->base;
+    return SQLITE_OK;
+}
+
+//! xDisconnect and xDestroy
+static int
+resultfiles_disconnect(sqlite3_vtab* vtab)
+{
+    delete (ResultFilesTable*)vtab;
+    return SQLITE_OK;
+}
+
+//! xBestIndex: push equality constraints into the scanner
+static int
+resultfiles_best_index(sqlite3_vtab* /* vtab */, sqlite3_index_info* info)
+{
+    std::ostringstream cols;
+    int argc = 0;
+
+    for (int i = 0; i < info->nConstraint; ++i)
+    {
+        const sqlite3_index_info::sqlite3_index_constraint& c =
+            info->aConstraint[i];
+
+        if (!c.usable || c.iColumn < 0 || c.op != SQLITE_INDEX_CONSTRAINT_EQ)
+            continue;
+
+#if SQLITE_VERSION_NUMBER >= 3022000
+        // text comparison in the scanner is only valid for BINARY collation
+        if (sqlite3_stricmp(sqlite3_vtab_collation(info, i), "BINARY") != 0)
+            continue;
+#endif
+
+        info->aConstraintUsage[i].argvIndex = ++argc;
+        info->aConstraintUsage[i].omit = 0;
+        cols << c.iColumn << ' ';
+    }
+
+    info->idxNum = argc;
+    info->idxStr = sqlite3_mprintf("%s", cols.str().c_str());
+    info->needToFreeIdxStr = 1;
+    info->estimatedCost = 1e6 / (1 + 10 * argc);
+
+    return SQLITE_OK;
+}
+
+//! xOpen
+static int
+resultfiles_open(sqlite3_vtab* /* vtab */, sqlite3_vtab_cursor** ppCursor)
+{
+    ResultFilesCursor* cur = new ResultFilesCursor;
+    memset(&cur->base, 0, sizeof(cur->base));
+    cur->file = 0;
+    cur->row = 0;
+    cur->rowid = 0;
+
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
+
+//! xClose
+static int
+resultfiles_close(sqlite3_vtab_cursor* cursor)
+{
+    delete (ResultFilesCursor*)cursor;
+    return SQLITE_OK;
+}
+
+//! xFilter: start a scan with the equality constraints chosen by xBestIndex
+static int
+resultfiles_filter(sqlite3_vtab_cursor* cursor, int /* idxNum */,
+                   const char* idxStr, int argc, sqlite3_value** argv)
+{
+    ResultFilesCursor* cur = (ResultFilesCursor*)cursor;
+    ResultFilesTable* tab = (ResultFilesTable*)cursor->pVtab;
+
+    cur->constraints.clear();
+
+    std::istringstream cols(idxStr ? idxStr : "");
+    for (int i = 0; i < argc; ++i)
+    {
+        ResultFilesConstraint c;
+        cols >> c.col;
+        c.type = sqlite3_value_type(argv[i]);
+        c.ival = sqlite3_value_int64(argv[i]);
+        c.dval = sqlite3_value_double(argv[i]);
+
+        const unsigned char* text = sqlite3_value_text(argv[i]);
+        if (text) c.text.assign((const char*)text, sqlite3_value_bytes(argv[i]));
+
+        cur->constraints.push_back(c);
+    }
+
+    cur->file = 0;
+    cur->data.reset();
+    cur->rowid = 0;
+
+    try {
+        resultfiles_seek(tab, cur, 0);
+    }
+    catch (std::runtime_error& e) {
+        sqlite3_free(tab->base.zErrMsg);
+        tab->base.zErrMsg = sqlite3_mprintf("%s", e.what());
+        return SQLITE_ERROR;
+    }
+
+    return SQLITE_OK;
+}
+
+//! xNext
+static int
+resultfiles_next(sqlite3_vtab_cursor* cursor)
+{
+    ResultFilesCursor* cur = (ResultFilesCursor*)cursor;
+    ResultFilesTable* tab = (ResultFilesTable*)cursor->pVtab;
+
+    ++cur->rowid;
+
+    try {
+        resultfiles_seek(tab, cur, cur->row + 1);
+    }
+    catch (std::runtime_error& e) {
+        sqlite3_free(tab->base.zErrMsg);
+        tab->base.zErrMsg = sqlite3_mprintf("%s", e.what());
+        return SQLITE_ERROR;
+    }
+
+    return SQLITE_OK;
+}
+
+//! xEof
+static int
+resultfiles_eof(sqlite3_vtab_cursor* cursor)
+{
+    ResultFilesCursor* cur = (ResultFilesCursor*)cursor;
+    ResultFilesTable* tab = (ResultFilesTable*)cursor->pVtab;
+
+    return cur->file >= tab->files.size();
+}
+
+//! xColumn: convert cell according to the detected column type
+static int
+resultfiles_column(sqlite3_vtab_cursor* cursor, sqlite3_context* ctx, int col)
+{
+    ResultFilesCursor* cur = (ResultFilesCursor*)cursor;
+    ResultFilesTable* tab = (ResultFilesTable*)cursor->pVtab;
+
+    const ResultFileData::row_type& row = cur->data->rows[cur->row];
+
+    int k = cur->colmap[col];
+    if (k < 0 || k >= (int)row.size() || !row[k].first) {
+        sqlite3_result_null(ctx);
+        return SQLITE_OK;
+    }
+
+    const std::string& cell = row[k].second;
+    FieldSet::fieldtype t = tab->fieldset.type(col);
+
+    sqlite3_int64 ival;
+    double dval;
+
+    if (t == FieldSet::T_INTEGER && resultfile_int64(cell, ival))
+        sqlite3_result_int64(ctx, ival);
+    else if (t != FieldSet::T_VARCHAR && resultfile_double(cell, dval))
+        sqlite3_result_double(ctx, dval);
+    else
+        sqlite3_result_text(ctx, cell.data(), cell.size(), SQLITE_TRANSIENT);
+
+    return SQLITE_OK;
+}
+
+//! xRowid
+static int
+resultfiles_rowid(sqlite3_vtab_cursor* cursor, sqlite3_int64* pRowid)
+{
+    *pRowid = ((ResultFilesCursor*)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+//! method table of the read-only resultfiles module
+static sqlite3_module
+resultfiles_module()
+{
+    // further methods are NULL
+    sqlite3_module module;
+    memset(&module, 0, sizeof(module));
+
+    module.iVersion = 0;
+    module.xCreate = resultfiles_connect;
+    module.xConnect = resultfiles_connect;
+    module.xBestIndex = resultfiles_best_index;
+    module.xDisconnect = resultfiles_disconnect;
+    module.xDestroy = resultfiles_disconnect;
+    module.xOpen = resultfiles_open;
+    module.xClose = resultfiles_close;
+    module.xFilter = resultfiles_filter;
+    module.xNext = resultfiles_next;
+    module.xEof = resultfiles_eof;
+    module.xColumn = resultfiles_column;
+    module.xRowid = resultfiles_rowid;
+
+    return module;
+}
+
+//! register virtual table module "resultfiles" with the database connection
+int RegisterResultFilesModule(sqlite3* db)
+{
+    // initialized once, also when sessions connect concurrently
+    static const sqlite3_module module = resultfiles_module();
+
+    return sqlite3_create_module(db, "resultfiles", &module, NULL);
+}
@@ -0,0 +1,506 @@
+/******************************************************************************
+ * src/sqlite-sketch.cpp
+ *
+ * SQLite aggregate functions computing approximate statistics in bounded
+ * memory with mergeable sketches:
+ *
+ *   approx_quantile(x, q [, compression])
+ *   approx_median(x [, compression])
+ *   approx_quantiles(x, '0.5,0.9,0.99' [, compression])  -> JSON array
+ *
+ *   tdigest(x [, compression])          -> sketch blob
+ *   tdigest_merge(sketch)               -> merged sketch blob
+ *   tdigest_quantile(sketch, q)         -> quantile of a sketch
+ *
+ * Quantiles are estimated with a merging t-digest: values are clustered into
+ * at most about "compression" centroids, which are small near the tails, so
+ * p1 or p99 are much more accurate than the median. The default compression
+ * of 100 keeps about 1-2 KiB per group.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "strtools.h"
+
+//! Merging t-digest (Dunning and Ertl) for streaming quantile estimation.
+class TDigest
+{
+public:
+    //! cluster of values
+    struct Centroid
+    {
+        double mean, weight;
+
+        Centroid(double m, double w)
+            : mean(m), weight(w)
+        { }
+
+        bool operator < (const Centroid& b) const
+        {
+            return mean < b.mean;
+        }
+    };
+
+protected:
+    //! accuracy parameter, bounds the number of centroids
+    double m_compression;
+
+    //! compressed centroids, ordered by mean
+    std::vector<Centroid> m_centroids;
+
+    //! unmerged values or centroids
+    std::vector<Centroid> m_buffer;
+
+    //! total weight of m_centroids
+    double m_total;
+
+    //! minimum and maximum of all values
+    double m_min, m_max;
+
+    //! scale function k1, which keeps centroids small near the tails
+    double scale(double q) const
+    {
+        return m_compression / (2 * M_PI) * asin(2 * q - 1);
+    }
+
+    //! merge buffer into the centroids
+    void compress()
+    {
+        if (m_buffer.empty()) return;
+
+        m_buffer.insert(m_buffer.end(), m_centroids.begin(), m_centroids.end());
+        std::sort(m_buffer.begin(), m_buffer.end());
+
+        double total = 0;
+        for (size_t i = 0; i < m_buffer.size(); ++i)
+            total += m_buffer[i].weight;
+
+        m_centroids.clear();
+
+        Centroid cur = m_buffer[0];
+        double wsofar = 0;
+
+        for (size_t i = 1; i < m_buffer.size(); ++i)
+        {
+            const Centroid& x = m_buffer[i];
+
+            double q0 = wsofar / total;
+            double q2 = (wsofar + cur.weight + x.weight) / total;
+
+            if (scale(q2) - scale(q0) <= 1.0)
+            {
+                // merge x into current centroid
+                cur.weight += x.weight;
+                cur.mean += (x.mean - cur.mean) * x.weight / cur.weight;
+            }
+            else
+            {
+                wsofar += cur.weight;
+                m_centroids.push_back(cur);
+                cur = x;
+            }
+        }
+        m_centroids.push_back(cur);
+
+        m_total = total;
+        m_buffer.clear();
+    }
+
+public:
+    //! default accuracy parameter
+    static const int default_compression = 100;
+
+    explicit TDigest(double compression = default_compression)
+        : m_compression(compression), m_total(0),
+          m_min(INFINITY), m_max(-INFINITY)
+    { }
+
+    //! add a value with weight
+    void add(double x, double w = 1.0)
+    {
+        m_buffer.push_back(Centroid(x, w));
+        m_min = std::min(m_min, x);
+        m_max = std::max(m_max, x);
+
+        if (m_buffer.size() >= 5 * (size_t)m_compression + 10)
+            compress();
+    }
+
+    //! merge another digest into this one
+    void merge(const TDigest& other)
+    {
+        m_buffer.insert(m_buffer.end(),
+                        other.m_centroids.begin(), other.m_centroids.end());
+        m_buffer.insert(m_buffer.end(),
+                        other.m_buffer.begin(), other.m_buffer.end());
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+
+        compress();
+    }
+
+    //! true if no values were added
+    bool empty() const
+    {
+        return m_centroids.empty() && m_buffer.empty();
+    }
+
+    //! estimate quantile q in [0,1]
+    double quantile(double q)
+    {
+        compress();
+        assert(!m_centroids.empty());
+
+        const std::vector<Centroid>& c = m_centroids;
+        if (c.size() == 1) return c[0].mean;
+
+        double index = q * m_total;
+
+        if (index < 1) return m_min;
+        if (index > m_total - 1) return m_max;
+
+        // between minimum and first centroid
+        double wsofar = c[0].weight / 2;
+        if (index < wsofar) {
+            return m_min + (index - 1) / (wsofar - 1) * (c[0].mean - m_min);
+        }
+
+        // interpolate between adjacent centroids
+        for (size_t i = 0; i + 1 < c.size(); ++i)
+        {
+            double dw = (c[i].weight + c[i + 1].weight) / 2;
+
+            if (wsofar + dw > index)
+            {
+                double z1 = index - wsofar;
+                double z2 = wsofar + dw - index;
+                return (c[i].mean * z2 + c[i + 1].mean * z1) / dw;
+            }
+            wsofar += dw;
+        }
+
+        // between last centroid and maximum
+        double lastw = c.back().weight / 2;
+        double z1 = index - wsofar;
+        if (lastw <= 1) return m_max;
+        return c.back().mean + z1 / (lastw - 1) * (m_max - c.back().mean);
+    }
+
+    //! serialize to a blob of doubles: compression, min, max, count, then
+    //! (mean, weight) pairs.
+    std::string serialize()
+    {
+        compress();
+
+        std::vector<double> out;
+        out.push_back(m_compression);
+        out.push_back(m_min);
+        out.push_back(m_max);
+        out.push_back(m_centroids.size());
+        for (size_t i = 0; i < m_centroids.size(); ++i) {
+            out.push_back(m_centroids[i].mean);
+            out.push_back(m_centroids[i].weight);
+        }
+
+        return std::string((const char*)out.data(), out.size() * sizeof(double));
+    }
+
+    //! deserialize from blob, returns false if malformed
+    bool deserialize(const void* data, size_t size)
+    {
+        if (size % sizeof(double) != 0 || size < 4 * sizeof(double))
+            return false;
+
+        std::vector<double> in(size / sizeof(double));
+        memcpy(in.data(), data, size);
+
+        // compression within the range accepted from SQL, check the centroid
+        // count before converting it
+        if (!(in[0] >= 10 && in[0] <= 10000) ||
+            !(in[3] >= 0 && in[3] <= (in.size() - 4) / 2) ||
+            in[3] != std::floor(in[3]) ||
+            in.size() != 4 + 2 * (size_t)in[3])
+            return false;
+
+        size_t n = (size_t)in[3];
+
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::isfinite(in[4 + 2 * i]) ||
+                !std::isfinite(in[5 + 2 * i]) || !(in[5 + 2 * i] > 0))
+                return false;
+        }
+
+        m_compression = in[0];
+        m_min = in[1];
+        m_max = in[2];
+        m_centroids.clear();
+        m_buffer.clear();
+        m_total = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            m_centroids.push_back(Centroid(in[4 + 2 * i], in[5 + 2 * i]));
+            m_total += in[5 + 2 * i];
+        }
+        return true;
+    }
+};
+
+/******************************************************************************/
+// Aggregate Functions
+
+//! aggregate context: pointer to the digest, allocated on first value
+struct TDigestCtx
+{
+    TDigest* td;
+
+    //! requested quantiles, from the first row
+    std::vector<double>* qs;
+};
+
+//! return aggregate context, creating the digest with compression from argv
+static TDigestCtx*
+tdigest_context(sqlite3_context* ctx, sqlite3_value* compression)
+{
+    TDigestCtx* p = (TDigestCtx*)sqlite3_aggregate_context(ctx, sizeof(*p));
+    if (!p) return NULL;
+
+    if (!p->td)
+    {
+        double c = TDigest::default_compression;
+        if (compression && sqlite3_value_numeric_type(compression) != SQLITE_NULL)
+            c = std::max(10.0, std::min(10000.0, sqlite3_value_double(compression)));
+
+        p->td = new TDigest(c);
+    }
+    return p;
+}
+
+//! free digest in the aggregate context
+static void
+tdigest_free(TDigestCtx* p)
+{
+    delete p->td;
+    delete p->qs;
+    p->td = NULL;
+    p->qs = NULL;
+}
+
+//! parse a comma-separated list of quantiles
+static inline bool
+tdigest_parse_quantiles(const std::string& str, std::vector<double>& out)
+{
+    std::vector<std::string> list = split(str, ',');
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+        std::string s = trim(list[i]);
+        char* endp;
+        double q = strtod(s.c_str(), &endp);
+        if (s.empty() || *endp != 0 || !(q >= 0.0 && q <= 1.0))
+            return false;
+        out.push_back(q);
+    }
+    return !out.empty();
+}
+
+//! xStep of approx_median(x [, c])
+static void
+approx_median_step(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    if (sqlite3_value_numeric_type(argv[0]) == SQLITE_NULL) return;
+
+    TDigestCtx* p = tdigest_context(ctx, argc >= 2 ? argv[1] : NULL);
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    p->td->add(sqlite3_value_double(argv[0]));
+}
+
+//! xStep of approx_quantile(x, q [, c]) and approx_quantiles(x, list [, c])
+static void
+approx_quantile_step(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    if (sqlite3_value_numeric_type(argv[0]) == SQLITE_NULL) return;
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) return;
+
+    TDigestCtx* p = tdigest_context(ctx, argc >= 3 ? argv[2] : NULL);
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    if (!p->qs)
+    {
+        // quantile argument is taken from the first row
+        p->qs = new std::vector<double>;
+
+        if (sqlite3_value_type(argv[1]) == SQLITE_TEXT) {
+            const char* str = (const char*)sqlite3_value_text(argv[1]);
+            if (!tdigest_parse_quantiles(str, *p->qs))
+                p->qs->clear();
+        }
+        else {
+            double q = sqlite3_value_double(argv[1]);
+            if (q >= 0.0 && q <= 1.0) p->qs->push_back(q);
+        }
+    }
+
+    p->td->add(sqlite3_value_double(argv[0]));
+}
+
+//! xFinal of approx_median()
+static void
+approx_median_final(sqlite3_context* ctx)
+{
+    TDigestCtx* p = (TDigestCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->td) return;
+
+    sqlite3_result_double(ctx, p->td->quantile(0.5));
+    tdigest_free(p);
+}
+
+//! xFinal of approx_quantile(), NULL for q outside [0,1]
+static void
+approx_quantile_final(sqlite3_context* ctx)
+{
+    TDigestCtx* p = (TDigestCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->td) return;
+
+    if (p->qs && p->qs->size() == 1)
+        sqlite3_result_double(ctx, p->td->quantile((*p->qs)[0]));
+
+    tdigest_free(p);
+}
+
+//! xFinal of approx_quantiles(): JSON array of the quantiles
+static void
+approx_quantiles_final(sqlite3_context* ctx)
+{
+    TDigestCtx* p = (TDigestCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->td) return;
+
+    if (p->qs && !p->qs->empty())
+    {
+        std::ostringstream os;
+        os << std::setprecision(15) << '[';
+        for (size_t i = 0; i < p->qs->size(); ++i) {
+            if (i != 0) os << ',';
+            os << p->td->quantile((*p->qs)[i]);
+        }
+        os << ']';
+
+        std::string str = os.str();
+        sqlite3_result_text(ctx, str.data(), str.size(), SQLITE_TRANSIENT);
+    }
+    else
+    {
+        sqlite3_result_error(ctx, "approx_quantiles: expected a list of "
+                             "quantiles in [0,1] like '0.5,0.9'", -1);
+    }
+
+    tdigest_free(p);
+}
+
+//! xStep of tdigest_merge(sketch)
+static void
+tdigest_merge_step(sqlite3_context* ctx, int /* argc */, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) return;
+
+    TDigest other;
+    if (!other.deserialize(sqlite3_value_blob(argv[0]),
+                           sqlite3_value_bytes(argv[0])))
+        return sqlite3_result_error(ctx, "tdigest_merge: invalid sketch", -1);
+
+    TDigestCtx* p = tdigest_context(ctx, NULL);
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    p->td->merge(other);
+}
+
+//! xFinal of tdigest() and tdigest_merge(): sketch blob
+static void
+tdigest_final(sqlite3_context* ctx)
+{
+    TDigestCtx* p = (TDigestCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->td) return;
+
+    std::string blob = p->td->serialize();
+    sqlite3_result_blob(ctx, blob.data(), blob.size(), SQLITE_TRANSIENT);
+
+    tdigest_free(p);
+}
+
+//! scalar tdigest_quantile(sketch, q)
+static void
+tdigest_quantile_func(sqlite3_context* ctx, int /* argc */, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) return;
+    if (sqlite3_value_numeric_type(argv[1]) == SQLITE_NULL) return;
+
+    TDigest td;
+    if (!td.deserialize(sqlite3_value_blob(argv[0]),
+                        sqlite3_value_bytes(argv[0])))
+        return sqlite3_result_error(ctx, "tdigest_quantile: invalid sketch", -1);
+
+    double q = sqlite3_value_double(argv[1]);
+    if (td.empty() || !(q >= 0.0 && q <= 1.0)) return;
+
+    sqlite3_result_double(ctx, td.quantile(q));
+}
+
+//! register sketch-based aggregate functions with the database connection
+int RegisterSketchFunctions(sqlite3* db)
+{
+    static const struct {
+        const char* name;
+        int nargs;
+        void (* step)(sqlite3_context*, int, sqlite3_value**);
+        void (* final)(sqlite3_context*);
+    } aggs[] = {
+        { "approx_median", 1, approx_median_step, approx_median_final },
+        { "approx_median", 2, approx_median_step, approx_median_final },
+        { "approx_quantile", 2, approx_quantile_step, approx_quantile_final },
+        { "approx_quantile", 3, approx_quantile_step, approx_quantile_final },
+        { "approx_quantiles", 2, approx_quantile_step, approx_quantiles_final },
+        { "approx_quantiles", 3, approx_quantile_step, approx_quantiles_final },
+        { "tdigest", 1, approx_median_step, tdigest_final },
+        { "tdigest", 2, approx_median_step, tdigest_final },
+        { "tdigest_merge", 1, tdigest_merge_step, tdigest_final },
+    };
+
+    int rc = SQLITE_OK;
+
+    for (size_t i = 0; i < sizeof(aggs) / sizeof(aggs[0]); ++i)
+    {
+        rc = sqlite3_create_function(db, aggs[i].name, aggs[i].nargs,
+                                     SQLITE_UTF8, NULL,
+                                     NULL, aggs[i].step, aggs[i].final);
+        if (rc != SQLITE_OK) return rc;
+    }
+
+    return sqlite3_create_function(db, "tdigest_quantile", 2,
+                                   SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                                   tdigest_quantile_func, NULL, NULL);
+}
@@ -0,0 +1,669 @@
+/******************************************************************************
+ * src/sqlite-stats.cpp
+ *
+ * SQLite aggregate functions for statistical analysis of experiment results:
+ *
+ *   bootstrap_ci(x, level, resamples [, seed])         -> '[lo,hi]'
+ *   bootstrap_ci_ratio(a, b, level, resamples [, seed]) -> '[lo,hi]'
+ *
+ *   linreg_slope(y, x), linreg_intercept(y, x), linreg_r2(y, x)
+ *   loglog_slope(y, x), loglog_intercept(y, x), loglog_r2(y, x)
+ *
+ *   arg_min(ret, key), arg_max(ret, key)
+ *   top_k(ret, key, k), bottom_k(ret, key, k)                -> '[ret,...]'
+ *
+ * bootstrap_ci() returns a percentile bootstrap confidence interval of the
+ * mean of x, bootstrap_ci_ratio() one of SUM(a)/SUM(b), i.e. of a speedup, by
+ * resampling the rows (pairs of a and b). The results are JSON arrays, use
+ * json_extract(ci, '$[0]') for the lower bound. Resamples whose statistic is not
+ * finite, e.g. whose SUM(b) is 0, are dropped, and if more than half of them
+ * are dropped the result is an error.
+ *
+ * The linreg_*() aggregates fit y = slope * x + intercept by least squares in
+ * one pass, the loglog_*() variants fit log(y) = slope * log(x) + intercept,
+ * e.g. to check a complexity exponent, and skip non-positive values. They
+ * follow the SQL standard regr_slope(), regr_intercept() and regr_r2().
+ *
+ * arg_min() and arg_max() return ret of the row with the smallest or largest
+ * key, top_k() and bottom_k() a JSON array of ret of the k rows with largest
+ * or smallest keys, ordered by key. Keys are compared like ORDER BY with
+ * BINARY collation, NULL keys are skipped and ties go to the earlier row.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+/******************************************************************************/
+// Bootstrap Confidence Intervals
+
+//! SplitMix64, used to derive independent seeds
+static inline uint64_t
+splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//! Small and fast xoshiro256** pseudo-random number generator.
+class Xoshiro256
+{
+protected:
+    uint64_t s[4];
+
+    static inline uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    explicit Xoshiro256(uint64_t seed)
+    {
+        for (unsigned int i = 0; i < 4; ++i)
+            s[i] = splitmix64(seed);
+    }
+
+    uint64_t operator () ()
+    {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+    //! uniform random index in [0,n) (Lemire's multiply-shift)
+    size_t index(size_t n)
+    {
+        return (size_t)(((unsigned __int128)(*this)() * n) >> 64);
+    }
+};
+
+//! aggregate context of bootstrap_ci() and bootstrap_ci_ratio()
+struct BootstrapCtx
+{
+    //! values of x or a
+    std::vector<double>* a;
+
+    //! values of b (ratio only)
+    std::vector<double>* b;
+
+    //! parameters from the first row
+    double level;
+    sqlite3_int64 resamples;
+    sqlite3_int64 seed;
+};
+
+//! compute resampled statistics [begin,end), resample r uses its own PRNG
+//! stream such that results do not depend on the number of threads.
+static void
+bootstrap_resample(const BootstrapCtx* p, uint64_t seed,
+                   std::vector<double>* stats, size_t begin, size_t end)
+{
+    const std::vector<double>& a = *p->a;
+    size_t n = a.size();
+
+    for (size_t r = begin; r < end; ++r)
+    {
+        uint64_t rseed = seed + r;
+        Xoshiro256 rng(splitmix64(rseed));
+
+        double sa = 0, sb = 0;
+        if (p->b)
+        {
+            const std::vector<double>& b = *p->b;
+            for (size_t i = 0; i < n; ++i) {
+                size_t k = rng.index(n);
+                sa += a[k], sb += b[k];
+            }
+            (*stats)[r] = sa / sb;
+        }
+        else
+        {
+            for (size_t i = 0; i < n; ++i)
+                sa += a[rng.index(n)];
+            (*stats)[r] = sa / n;
+        }
+    }
+}
+
+//! return interpolated quantile q of sorted values
+static inline double
+bootstrap_percentile(const std::vector<double>& v, double q)
+{
+    double pos = q * (v.size() - 1);
+    size_t k = (size_t)pos;
+    if (k + 1 >= v.size()) return v.back();
+    return v[k] + (pos - k) * (v[k + 1] - v[k]);
+}
+
+//! write an interval bound as JSON number, or null if it is not finite
+static inline void
+bootstrap_json_bound(std::ostream& os, double d)
+{
+    if (std::isfinite(d))
+        os << d;
+    else
+        os << "null";
+}
+
+//! collect one row of bootstrap_ci() or bootstrap_ci_ratio()
+static void
+bootstrap_add(sqlite3_context* ctx, int argc, sqlite3_value** argv, bool ratio)
+{
+    int narg = ratio ? 2 : 1;
+
+    for (int i = 0; i < narg; ++i) {
+        if (sqlite3_value_numeric_type(argv[i]) == SQLITE_NULL) return;
+    }
+
+    BootstrapCtx* p = (BootstrapCtx*)sqlite3_aggregate_context(ctx, sizeof(*p));
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    if (!p->a)
+    {
+        p->a = new std::vector<double>;
+        if (ratio) p->b = new std::vector<double>;
+
+        p->level = sqlite3_value_double(argv[narg]);
+        p->resamples = sqlite3_value_int64(argv[narg + 1]);
+        p->seed = (argc > narg + 2) ? sqlite3_value_int64(argv[narg + 2]) : 1;
+    }
+
+    p->a->push_back(sqlite3_value_double(argv[0]));
+    if (ratio) p->b->push_back(sqlite3_value_double(argv[1]));
+}
+
+//! xStep of bootstrap_ci(x, level, resamples [, seed])
+static void
+bootstrap_step(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    bootstrap_add(ctx, argc, argv, false);
+}
+
+//! xStep of bootstrap_ci_ratio(a, b, level, resamples [, seed])
+static void
+bootstrap_ratio_step(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    bootstrap_add(ctx, argc, argv, true);
+}
+
+//! xFinal: resample, in parallel for large inputs, and format interval
+static void
+bootstrap_final(sqlite3_context* ctx)
+{
+    BootstrapCtx* p = (BootstrapCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->a) return;
+
+    if (!(p->level > 0.0 && p->level < 1.0)) {
+        sqlite3_result_error(ctx, "bootstrap_ci: level must be in (0,1)", -1);
+    }
+    else if (p->resamples < 1 || p->resamples > 100000000) {
+        sqlite3_result_error(ctx, "bootstrap_ci: invalid number of resamples", -1);
+    }
+    else
+    {
+        size_t R = p->resamples;
+        std::vector<double> stats(R);
+
+        // split resamples among threads if there is enough work
+        size_t work = R * p->a->size();
+        size_t nthreads = std::min<size_t>(
+            std::max(1u, std::thread::hardware_concurrency()),
+            std::max<size_t>(1, work / 1000000));
+        nthreads = std::min(nthreads, R);
+
+        if (nthreads <= 1) {
+            bootstrap_resample(p, p->seed, &stats, 0, R);
+        }
+        else {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < nthreads; ++t) {
+                threads.push_back(std::thread(
+                                      bootstrap_resample, p, (uint64_t)p->seed, &stats,
+                                      R * t / nthreads, R * (t + 1) / nthreads));
+            }
+            for (size_t t = 0; t < nthreads; ++t)
+                threads[t].join();
+        }
+
+        // drop resamples with NaN or infinite statistics, which cannot be
+        // ordered, e.g. ratios whose denominator sum is 0.
+        stats.erase(std::remove_if(stats.begin(), stats.end(),
+                                   [](double d) { return !std::isfinite(d); }),
+                    stats.end());
+
+        if (stats.size() * 2 < R) {
+            sqlite3_result_error(
+                ctx, "bootstrap_ci: statistic is not finite in most resamples", -1);
+        }
+        else
+        {
+            std::sort(stats.begin(), stats.end());
+
+            double alpha = (1.0 - p->level) / 2;
+
+            std::ostringstream os;
+            os << std::setprecision(15) << '[';
+            bootstrap_json_bound(os, bootstrap_percentile(stats, alpha));
+            os << ',';
+            bootstrap_json_bound(os, bootstrap_percentile(stats, 1.0 - alpha));
+            os << ']';
+
+            std::string str = os.str();
+            sqlite3_result_text(ctx, str.data(), str.size(), SQLITE_TRANSIENT);
+        }
+    }
+
+    delete p->a;
+    delete p->b;
+}
+
+/******************************************************************************/
+// Linear Regression
+
+//! aggregate context: running means and co-moments, updated like Welford's
+//! algorithm to avoid cancellation in sum of squares.
+struct LinRegCtx
+{
+    sqlite3_int64 n;
+    double mean_x, mean_y;
+    double sxx, syy, sxy;
+};
+
+//! add point (x,y) to the regression
+static void
+linreg_add(sqlite3_context* ctx, double x, double y)
+{
+    LinRegCtx* p = (LinRegCtx*)sqlite3_aggregate_context(ctx, sizeof(*p));
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    ++p->n;
+    double dx = x - p->mean_x;
+    double dy = y - p->mean_y;
+    p->mean_x += dx / p->n;
+    p->mean_y += dy / p->n;
+    p->sxx += dx * (x - p->mean_x);
+    p->syy += dy * (y - p->mean_y);
+    p->sxy += dx * (y - p->mean_y);
+}
+
+//! xStep of linreg_*(y, x)
+static void
+linreg_step(sqlite3_context* ctx, int /* argc */, sqlite3_value** argv)
+{
+    if (sqlite3_value_numeric_type(argv[0]) == SQLITE_NULL ||
+        sqlite3_value_numeric_type(argv[1]) == SQLITE_NULL) return;
+
+    linreg_add(ctx, sqlite3_value_double(argv[1]),
+               sqlite3_value_double(argv[0]));
+}
+
+//! xStep of loglog_*(y, x): regression on logarithms of positive values
+static void
+loglog_step(sqlite3_context* ctx, int /* argc */, sqlite3_value** argv)
+{
+    if (sqlite3_value_numeric_type(argv[0]) == SQLITE_NULL ||
+        sqlite3_value_numeric_type(argv[1]) == SQLITE_NULL) return;
+
+    double y = sqlite3_value_double(argv[0]);
+    double x = sqlite3_value_double(argv[1]);
+    if (!(x > 0 && y > 0)) return;
+
+    linreg_add(ctx, std::log(x), std::log(y));
+}
+
+//! return regression context, or NULL if the slope is undefined
+static LinRegCtx*
+linreg_context(sqlite3_context* ctx)
+{
+    LinRegCtx* p = (LinRegCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || p->n < 2 || p->sxx == 0) return NULL;
+    return p;
+}
+
+//! xFinal: slope of the fitted line
+static void
+linreg_slope_final(sqlite3_context* ctx)
+{
+    LinRegCtx* p = linreg_context(ctx);
+    if (!p) return;
+
+    sqlite3_result_double(ctx, p->sxy / p->sxx);
+}
+
+//! xFinal: intercept of the fitted line
+static void
+linreg_intercept_final(sqlite3_context* ctx)
+{
+    LinRegCtx* p = linreg_context(ctx);
+    if (!p) return;
+
+    sqlite3_result_double(ctx, p->mean_y - p->sxy / p->sxx * p->mean_x);
+}
+
+//! xFinal: coefficient of determination, 1 for constant y
+static void
+linreg_r2_final(sqlite3_context* ctx)
+{
+    LinRegCtx* p = linreg_context(ctx);
+    if (!p) return;
+
+    if (p->syy == 0)
+        sqlite3_result_double(ctx, 1.0);
+    else
+        sqlite3_result_double(ctx, p->sxy * p->sxy / (p->sxx * p->syy));
+}
+
+/******************************************************************************/
+// Arg Min/Max and Top-K
+
+//! compare two non-NULL values like ORDER BY with BINARY collation
+static int
+value_compare(sqlite3_value* a, sqlite3_value* b)
+{
+    int ta = sqlite3_value_type(a), tb = sqlite3_value_type(b);
+
+    // numbers sort before text, which sorts before blobs
+    int ca = (ta == SQLITE_INTEGER || ta == SQLITE_FLOAT) ? 0 : ta;
+    int cb = (tb == SQLITE_INTEGER || tb == SQLITE_FLOAT) ? 0 : tb;
+    if (ca != cb) return ca < cb ? -1 : 1;
+
+    if (ca == 0)
+    {
+        if (ta == SQLITE_INTEGER && tb == SQLITE_INTEGER) {
+            sqlite3_int64 ia = sqlite3_value_int64(a), ib = sqlite3_value_int64(b);
+            return ia < ib ? -1 : ia > ib ? 1 : 0;
+        }
+        double da = sqlite3_value_double(a), db = sqlite3_value_double(b);
+        return da < db ? -1 : da > db ? 1 : 0;
+    }
+
+    const void* pa = (ca == SQLITE_TEXT)
+                     ? (const void*)sqlite3_value_text(a) : sqlite3_value_blob(a);
+    const void* pb = (cb == SQLITE_TEXT)
+                     ? (const void*)sqlite3_value_text(b) : sqlite3_value_blob(b);
+    int na = sqlite3_value_bytes(a), nb = sqlite3_value_bytes(b);
+
+    int c = memcmp(pa, pb, std::min(na, nb));
+    if (c != 0) return c;
+    return na < nb ? -1 : na > nb ? 1 : 0;
+}
+
+//! aggregate context of arg_min() and arg_max(): copies of best row's values
+struct ArgMinCtx
+{
+    sqlite3_value* key;
+    sqlite3_value* ret;
+};
+
+//! xStep of arg_min(ret, key) and arg_max(ret, key), user data is the sign
+//! of the comparison for a better key.
+static void
+argmin_step(sqlite3_context* ctx, int /* argc */, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) return;
+
+    ArgMinCtx* p = (ArgMinCtx*)sqlite3_aggregate_context(ctx, sizeof(*p));
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    int sign = *(const int*)sqlite3_user_data(ctx);
+
+    if (p->key && value_compare(argv[1], p->key) * sign <= 0) return;
+
+    sqlite3_value_free(p->key);
+    sqlite3_value_free(p->ret);
+    p->key = sqlite3_value_dup(argv[1]);
+    p->ret = sqlite3_value_dup(argv[0]);
+
+    if (!p->key || !p->ret) return sqlite3_result_error_nomem(ctx);
+}
+
+//! xFinal of arg_min() and arg_max()
+static void
+argmin_final(sqlite3_context* ctx)
+{
+    ArgMinCtx* p = (ArgMinCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->key) return;
+
+    if (p->ret) sqlite3_result_value(ctx, p->ret);
+
+    sqlite3_value_free(p->key);
+    sqlite3_value_free(p->ret);
+}
+
+//! one kept row of top_k() and bottom_k()
+struct TopKEntry
+{
+    sqlite3_value* key;
+    sqlite3_value* ret;
+
+    //! row sequence number, earlier rows win ties
+    sqlite3_int64 seq;
+};
+
+//! ordering of entries: better ones first
+struct TopKBetter
+{
+    int sign;
+
+    bool operator () (const TopKEntry& a, const TopKEntry& b) const
+    {
+        int c = value_compare(a.key, b.key) * sign;
+        return c > 0 || (c == 0 && a.seq < b.seq);
+    }
+};
+
+//! aggregate context of top_k() and bottom_k(): heap with the worst kept row
+//! on top.
+struct TopKCtx
+{
+    std::vector<TopKEntry>* heap;
+    sqlite3_int64 k;
+    sqlite3_int64 seq;
+};
+
+//! free values of the kept rows
+static void
+topk_free(TopKCtx* p)
+{
+    for (size_t i = 0; i < p->heap->size(); ++i) {
+        sqlite3_value_free((*p->heap)[i].key);
+        sqlite3_value_free((*p->heap)[i].ret);
+    }
+    delete p->heap;
+    p->heap = NULL;
+}
+
+//! xStep of top_k(ret, key, k) and bottom_k(ret, key, k), user data is the
+//! sign of the comparison for a better key.
+static void
+topk_step(sqlite3_context* ctx, int /* argc */, sqlite3_value** argv)
+{
+    TopKCtx* p = (TopKCtx*)sqlite3_aggregate_context(ctx, sizeof(*p));
+    if (!p) return sqlite3_result_error_nomem(ctx);
+
+    if (!p->heap)
+    {
+        p->k = sqlite3_value_int64(argv[2]);
+        if (p->k < 1 || p->k > 1000000)
+            return sqlite3_result_error(ctx, "top_k: k must be in [1,1000000]", -1);
+        p->heap = new std::vector<TopKEntry>;
+    }
+
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) return;
+
+    TopKBetter better = { *(const int*)sqlite3_user_data(ctx) };
+    std::vector<TopKEntry>& heap = *p->heap;
+
+    TopKEntry e;
+    e.key = argv[1];
+    e.seq = p->seq++;
+
+    if ((sqlite3_int64)heap.size() == p->k)
+    {
+        // replace worst kept row if the new one is better
+        if (!better(e, heap.front())) return;
+
+        std::pop_heap(heap.begin(), heap.end(), better);
+        sqlite3_value_free(heap.back().key);
+        sqlite3_value_free(heap.back().ret);
+        heap.pop_back();
+    }
+
+    e.key = sqlite3_value_dup(argv[1]);
+    e.ret = sqlite3_value_dup(argv[0]);
+    if (!e.key || !e.ret) {
+        sqlite3_value_free(e.key);
+        sqlite3_value_free(e.ret);
+        return sqlite3_result_error_nomem(ctx);
+    }
+
+    heap.push_back(e);
+    std::push_heap(heap.begin(), heap.end(), better);
+}
+
+//! append value as JSON to string
+static void
+json_append(std::string& out, sqlite3_value* v)
+{
+    switch (sqlite3_value_type(v))
+    {
+    case SQLITE_INTEGER:
+        out += std::to_string((long long)sqlite3_value_int64(v));
+        break;
+    case SQLITE_FLOAT: {
+        double d = sqlite3_value_double(v);
+        if (std::isfinite(d)) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.15g", d);
+            out += buf;
+        }
+        else {
+            out += "null";
+        }
+        break;
+    }
+    case SQLITE_TEXT: {
+        const unsigned char* s = sqlite3_value_text(v);
+        int n = sqlite3_value_bytes(v);
+        out += '"';
+        for (int i = 0; i < n; ++i) {
+            if (s[i] == '"' || s[i] == '\\') {
+                out += '\\';
+                out += (char)s[i];
+            }
+            else if (s[i] < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", s[i]);
+                out += buf;
+            }
+            else {
+                out += (char)s[i];
+            }
+        }
+        out += '"';
+        break;
+    }
+    default:
+        out += "null";
+        break;
+    }
+}
+
+//! xFinal of top_k() and bottom_k(): JSON array ordered by key
+static void
+topk_final(sqlite3_context* ctx)
+{
+    TopKCtx* p = (TopKCtx*)sqlite3_aggregate_context(ctx, 0);
+    if (!p || !p->heap) return;
+
+    TopKBetter better = { *(const int*)sqlite3_user_data(ctx) };
+    std::vector<TopKEntry>& heap = *p->heap;
+    std::sort_heap(heap.begin(), heap.end(), better);
+
+    std::string out = "[";
+    for (size_t i = 0; i < heap.size(); ++i) {
+        if (i != 0) out += ',';
+        json_append(out, heap[i].ret);
+    }
+    out += ']';
+
+    sqlite3_result_text(ctx, out.data(), out.size(), SQLITE_TRANSIENT);
+
+    topk_free(p);
+}
+
+//! register statistical aggregate functions with the database connection
+int RegisterStatsFunctions(sqlite3* db)
+{
+    // comparison signs for a better key, passed as user data
+    static const int smaller = -1, larger = +1;
+
+    static const struct {
+        const char* name;
+        int nargs;
+        const int* sign;
+        void (* step)(sqlite3_context*, int, sqlite3_value**);
+        void (* final)(sqlite3_context*);
+    } aggs[] = {
+        { "bootstrap_ci", 3, NULL, bootstrap_step, bootstrap_final },
+        { "bootstrap_ci", 4, NULL, bootstrap_step, bootstrap_final },
+        { "bootstrap_ci_ratio", 4, NULL, bootstrap_ratio_step, bootstrap_final },
+        { "bootstrap_ci_ratio", 5, NULL, bootstrap_ratio_step, bootstrap_final },
+        { "linreg_slope", 2, NULL, linreg_step, linreg_slope_final },
+        { "linreg_intercept", 2, NULL, linreg_step, linreg_intercept_final },
+        { "linreg_r2", 2, NULL, linreg_step, linreg_r2_final },
+        { "loglog_slope", 2, NULL, loglog_step, linreg_slope_final },
+        { "loglog_intercept", 2, NULL, loglog_step, linreg_intercept_final },
+        { "loglog_r2", 2, NULL, loglog_step, linreg_r2_final },
+        { "arg_min", 2, &smaller, argmin_step, argmin_final },
+        { "arg_max", 2, &larger, argmin_step, argmin_final },
+        { "top_k", 3, &larger, topk_step, topk_final },
+        { "bottom_k", 3, &smaller, topk_step, topk_final },
+    };
+
+    for (size_t i = 0; i < sizeof(aggs) / sizeof(aggs[0]); ++i)
+    {
+        int rc = sqlite3_create_function(
+            db, aggs[i].name, aggs[i].nargs, SQLITE_UTF8, (void*)aggs[i].sign,
+            NULL, aggs[i].step, aggs[i].final);
+        if (rc != SQLITE_OK) return rc;
+    }
+
+    return SQLITE_OK;
+}
@@ -24,12 +24,21 @@
 #include "sqlite.h"
 #include "common.h"
 #include "strtools.h"
+#include "profile.h"
+#include "plan.h"
 
 #include <cassert>
+#include <cctype>
 #include <cstring>
 #include <iomanip>
+#include <map>
+#include <sstream>
 #include <vector>
 
+#include <sys/stat.h>
+
+#include <boost/regex.hpp>
+
 //! Execute a SQL query without parameters, throws on errors.
 SQLiteQuery::SQLiteQuery(class SQLiteDatabase& db, const std::string& query)
     : SqlQueryImpl(query),
@@ -37,15 +46,22 @@ SQLiteQuery::SQLiteQuery(class SQLiteDatabase& db, const std::string& query)
 {
     const char* zTail = 0;
 
-    int rc = sqlite3_prepare_v2(m_db.m_db, query.c_str(), query.size()+1,
+    int rc;
+    {
+        ProfileTimer timer(Profile::PREPARE);
+        rc = sqlite3_prepare_v2(m_db.m_db, query.c_str(), query.size()+1,
                                 &m_stmt, &zTail);
+    }
     if (rc != SQLITE_OK)
     {
         OUT_THROW("SQL query parse " << query << "\n" <<
                   "Failed at " << zTail << " : " << m_db.errmsg());
     }
 
-    rc = sqlite3_step(m_stmt);
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        rc = sqlite3_step(m_stmt);
+    }
 
     if (rc == SQLITE_ROW)
     {
@@ -70,8 +86,12 @@ SQLiteQuery::SQLiteQuery(class SQLiteDatabase& db, const std::string& query,
 {
     const char* zTail = 0;
 
-    int rc = sqlite3_prepare_v2(m_db.m_db, query.c_str(), query.size()+1,
+    int rc;
+    {
+        ProfileTimer timer(Profile::PREPARE);
+        rc = sqlite3_prepare_v2(m_db.m_db, query.c_str(), query.size()+1,
                                 &m_stmt, &zTail);
+    }
     if (rc != SQLITE_OK)
     {
         OUT_THROW("SQL query parse " << query << "\n" <<
@@ -84,7 +104,10 @@ SQLiteQuery::SQLiteQuery(class SQLiteDatabase& db, const std::string& query,
                           params[i].data(), params[i].size(), NULL);
     }
 
-    rc = sqlite3_step(m_stmt);
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        rc = sqlite3_step(m_stmt);
+    }
 
     if (rc == SQLITE_ROW)
     {
@@ -104,6 +127,21 @@ SQLiteQuery::SQLiteQuery(class SQLiteDatabase& db, const std::string& query,
 //! Free result
 SQLiteQuery::~SQLiteQuery()
 {
+    // add statement counters to the current directive's profile
+    if (Profile::Record* r = profile_record())
+    {
+        r->counter[Profile::FULLSCAN_STEP] +=
+            sqlite3_stmt_status(m_stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+        r->counter[Profile::SORT] +=
+            sqlite3_stmt_status(m_stmt, SQLITE_STMTSTATUS_SORT, 0);
+        r->counter[Profile::AUTOINDEX] +=
+            sqlite3_stmt_status(m_stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+#ifdef SQLITE_STMTSTATUS_VM_STEP
+        r->counter[Profile::VM_STEP] +=
+            sqlite3_stmt_status(m_stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+#endif
+    }
+
     sqlite3_finalize(m_stmt);
 }
 
@@ -138,18 +176,27 @@ unsigned int SQLiteQuery::current_row() const
 //! Advance current result row to next (or first if uninitialized)
 bool SQLiteQuery::step()
 {
+    Profile::Record* pr = profile_record();
+
     if (m_row == -1) {
         m_row++;
+        if (pr) pr->rows++;
         return true;
     }
     else if (m_row == -2) {
         return false;
     }
 
-    int rc = sqlite3_step(m_stmt);
+    int rc;
+    {
+        ProfileTimer timer(Profile::FETCH);
+        rc = sqlite3_step(m_stmt);
+    }
+
     if (rc == SQLITE_ROW)
     {
         ++m_row;
+        if (pr) pr->rows++;
         return true;
     }
     else if (rc == SQLITE_DONE)
@@ -202,15 +249,118 @@ std::string SQLiteQuery::text(unsigned int row, unsigned int col) const
 ////////////////////////////////////////////////////////////////////////////////
 
 extern int RegisterExtensionFunctions(sqlite3 *db);
+extern int RegisterResultFilesModule(sqlite3 *db);
+extern int RegisterPivotModule(sqlite3 *db);
+extern int RegisterSketchFunctions(sqlite3 *db);
+extern int RegisterStatsFunctions(sqlite3 *db);
+extern int RegisterHistogramFunctions(sqlite3 *db);
+
+//! check that a connection option value contains only [A-Za-z0-9_-], as it is
+//! pasted into a PRAGMA statement.
+static inline bool
+sqlite_option_value_ok(const std::string& value)
+{
+    if (value.empty()) return false;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (!isalnum((unsigned char)value[i]) && value[i] != '_' && value[i] != '-')
+            return false;
+    }
+    return true;
+}
+
+//! milliseconds to wait for locks held by other connections, e.g. parallel
+//! sessions of -j or the connection pool writing to the same database file.
+static const int sqlite_busy_timeout = 60000;
 
-//! try to connect to the database with default parameters
+//! try to connect to the database with given parameters. The database file
+//! may be followed by URI-style options "file?key=value&key=value". Tuning
+//! options (mmap_size, cache_size, journal_mode, wal, temp_store, threads,
+//! busy_timeout) are applied after opening, all others (mode=ro, immutable=1,
+//! cache=shared, ...) are passed to sqlite3_open_v2() as an URI.
 bool SQLiteDatabase::initialize(const std::string& params)
 {
     OUT("Connecting to SQLite3 database \"" << params << "\".");
 
-    // make connection to in-memory database
-    int rc = sqlite3_open_v2(params.c_str(), &m_db,
-                             SQLITE_OPEN_READWRITE, NULL);
+    std::string path = params, uri_options;
+    std::vector<std::string> pragmas;
+    int flags = SQLITE_OPEN_READWRITE;
+    int worker_threads = -1;
+
+    std::string::size_type qpos = params.find('?');
+    if (qpos != std::string::npos)
+    {
+        path = params.substr(0, qpos);
+
+        std::vector<std::string> options = split(params.substr(qpos+1), '&');
+        for (size_t i = 0; i < options.size(); ++i)
+        {
+            if (options[i].empty()) continue;
+
+            std::string key = options[i], value;
+            std::string::size_type eqpos = key.find('=');
+            if (eqpos != std::string::npos) {
+                value = key.substr(eqpos+1);
+                key = key.substr(0, eqpos);
+            }
+
+            if (key == "mmap_size" || key == "cache_size" ||
+                key == "journal_mode" || key == "temp_store" ||
+                key == "busy_timeout")
+            {
+                if (!sqlite_option_value_ok(value)) {
+                    OUT("Invalid SQLite3 option " << options[i]);
+                    return false;
+                }
+                pragmas.push_back("PRAGMA " + key + " = " + value);
+            }
+            else if (key == "wal")
+            {
+                // the journal mode is persistent, wal=0 switches back
+                if (value.empty() || value == "1" || value == "true")
+                    pragmas.push_back("PRAGMA journal_mode = WAL");
+                else if (value == "0" || value == "false")
+                    pragmas.push_back("PRAGMA journal_mode = DELETE");
+                else {
+                    OUT("Invalid SQLite3 option " << options[i]);
+                    return false;
+                }
+            }
+            else if (key == "threads")
+            {
+                if (!from_str(value, worker_threads) || worker_threads < 0) {
+                    OUT("Invalid SQLite3 option " << options[i]);
+                    return false;
+                }
+            }
+            else
+            {
+                // URI mode may not exceed the flags, allow mode=rwc to create
+                if (key == "mode" && (value == "rwc" || value == "memory"))
+                    flags |= SQLITE_OPEN_CREATE;
+
+                // pass on to SQLite's URI parser
+                uri_options += (uri_options.size() ? "&" : "") + options[i];
+            }
+        }
+    }
+
+    std::string filename = path;
+
+    if (uri_options.size())
+    {
+        // escape characters with a special meaning in URIs
+        filename = "file:";
+        for (size_t i = 0; i < path.size(); ++i)
+        {
+            if (path[i] == '%') filename += "%25";
+            else if (path[i] == '#') filename += "%23";
+            else filename += path[i];
+        }
+        filename += "?" + uri_options;
+        flags |= SQLITE_OPEN_URI;
+    }
+
+    int rc = sqlite3_open_v2(filename.c_str(), &m_db, flags, NULL);
     if (rc != SQLITE_OK)
     {
         OUT("Connection to SQLite3 failed: " << sqlite3_errmsg(m_db));
@@ -219,9 +369,40 @@ bool SQLiteDatabase::initialize(const std::string& params)
         return false;
     }
 
+    // wait for write locks of other connections instead of failing
+    sqlite3_busy_timeout(m_db, sqlite_busy_timeout);
+
+    // apply tuning options
+    for (size_t i = 0; i < pragmas.size(); ++i)
+    {
+        if (sqlite3_exec(m_db, pragmas[i].c_str(), NULL, NULL, NULL) != SQLITE_OK)
+            OUT("SQLite3 option failed: " << pragmas[i] << ": " << errmsg());
+    }
+
+    if (worker_threads >= 0)
+    {
+        // threads for parallel sorting, capped by SQLITE_MAX_WORKER_THREADS
+        sqlite3_limit(m_db, SQLITE_LIMIT_WORKER_THREADS, worker_threads);
+    }
+
     // register additional math functions
     RegisterExtensionFunctions(m_db);
 
+    // register virtual table module to query RESULT files in place
+    RegisterResultFilesModule(m_db);
+
+    // register virtual table module for crosstabs
+    RegisterPivotModule(m_db);
+
+    // register approximate quantile aggregates
+    RegisterSketchFunctions(m_db);
+
+    // register bootstrap and other statistics aggregates
+    RegisterStatsFunctions(m_db);
+
+    // register histogram aggregate and table-valued function
+    RegisterHistogramFunctions(m_db);
+
     return true;
 }
 
@@ -256,7 +437,11 @@ bool SQLiteDatabase::execute(const std::string& query)
 {
     char* zTail = 0;
 
-    int rc = sqlite3_exec(m_db, query.c_str(), NULL, NULL, &zTail);
+    int rc;
+    {
+        ProfileTimer timer(Profile::EXECUTE);
+        rc = sqlite3_exec(m_db, query.c_str(), NULL, NULL, &zTail);
+    }
 
     if (rc != SQLITE_OK)
     {
@@ -270,6 +455,10 @@ bool SQLiteDatabase::execute(const std::string& query)
 //! construct query object for given string
 SqlQuery SQLiteDatabase::query(const std::string& query)
 {
+    // claim result if the query was run on a pool connection
+    SqlQuery provided = claim_result(query);
+    if (provided) return provided;
+
     return SqlQuery( new SQLiteQuery(*this, query) );
 }
 
@@ -280,6 +469,380 @@ SqlQuery SQLiteDatabase::query(const std::string& query,
     return SqlQuery( new SQLiteQuery(*this, query, params) );
 }
 
+//! update planner statistics of a table after importing data
+void SQLiteDatabase::analyze(const std::string& table)
+{
+    // examine only a sample of rows per index (ignored before SQLite 3.32)
+    execute("PRAGMA analysis_limit = 1000");
+    execute("ANALYZE " + quote_field(table));
+}
+
+//! test whether a byte may start an identifier, like SQLite all non-ASCII
+//! bytes of UTF-8 characters are allowed.
+static inline bool
+sql_ident_start(unsigned char c)
+{
+    return isalpha(c) || c == '_' || c >= 0x80;
+}
+
+//! test whether a byte may continue an identifier
+static inline bool
+sql_ident_char(unsigned char c)
+{
+    return isalnum(c) || c == '_' || c == '$' || c >= 0x80;
+}
+
+//! split SQL text into tokens: words, numbers, quoted literals (with quotes)
+//! and operators.
+static inline std::vector<std::string>
+sql_tokenize(const std::string& sql)
+{
+    std::vector<std::string> out;
+    size_t i = 0, n = sql.size();
+
+    while (i < n)
+    {
+        unsigned char c = sql[i];
+        size_t j = i + 1;
+
+        if (isspace(c)) {
+            ++i;
+            continue;
+        }
+        else if (c == '-' && j < n && sql[j] == '-') {
+            // skip comment until end of line
+            while (i < n && sql[i] != '\n') ++i;
+            continue;
+        }
+        else if (sql_ident_start(c)) {
+            while (j < n && sql_ident_char(sql[j]))
+                ++j;
+        }
+        else if (isdigit(c)) {
+            while (j < n && (isalnum((unsigned char)sql[j]) || sql[j] == '.'))
+                ++j;
+        }
+        else if (c == '\'' || c == '"' || c == '`' || c == '[') {
+            char close = (c == '[') ? ']' : c;
+            while (j < n && sql[j] != close) ++j;
+            ++j;
+        }
+        else if (j < n && strchr("<>=!|", c) && strchr("<>=|", sql[j])) {
+            ++j;
+        }
+
+        out.push_back(sql.substr(i, std::min(j, n) - i));
+        i = j;
+    }
+
+    return out;
+}
+
+//! match a token against a table's columns, returns the column name or an
+//! empty string.
+static inline std::string
+sql_match_column(const std::string& token,
+                 const std::map<std::string, std::string>& columns)
+{
+    std::string name = token;
+
+    if (name.size() >= 2 && (name[0] == '"' || name[0] == '`' || name[0] == '['))
+        name = name.substr(1, name.size() - 2);
+    else if (name.empty() || !sql_ident_start(name[0]))
+        return std::string();
+
+    std::map<std::string, std::string>::const_iterator it =
+        columns.find(str_tolower(name));
+
+    return (it != columns.end()) ? it->second : std::string();
+}
+
+//! append a column to a list if not already contained
+static inline void
+add_unique(std::vector<std::string>& list, const std::string& col)
+{
+    if (std::find(list.begin(), list.end(), col) == list.end())
+        list.push_back(col);
+}
+
+//! test if name is a regular or temporary table, which can be indexed, and
+//! not a view, virtual table or subquery.
+static inline bool
+sqlite_is_base_table(SQLiteDatabase& db, const std::string& name)
+{
+    std::vector<std::string> params;
+    params.push_back(name);
+
+    SQLiteQuery sql(db,
+                    "SELECT sql FROM sqlite_master "
+                    "WHERE type='table' AND name = $1 "
+                    "UNION ALL "
+                    "SELECT sql FROM sqlite_temp_master "
+                    "WHERE type='table' AND name = $1",
+                    params);
+
+    return sql.step() && !is_prefix(str_tolower(sql.text(0)), "create virtual");
+}
+
+//! return index column list suggested for a query on table, or empty
+std::vector<std::string>
+SQLiteDatabase::advise_index(const std::string& query, const std::string& table)
+{
+    if (!sqlite_is_base_table(*this, table))
+        return std::vector<std::string>();
+
+    // map lower-case column names to their declared names
+    std::map<std::string, std::string> columns;
+
+    SQLiteQuery info(*this, "PRAGMA table_info(" + quote_field(table) + ")");
+    while (info.step())
+        columns[str_tolower(info.text(1))] = info.text(1);
+
+    // walk over tokens and collect columns compared for equality or ranges in
+    // WHERE and ON clauses, and the leading plain columns of GROUP BY and
+    // ORDER BY.
+    enum { C_NONE, C_SELECT, C_WHERE, C_GROUP, C_ORDER };
+
+    std::vector<std::string> tokens = sql_tokenize(query);
+    std::vector<int> clause(1, C_NONE); // clause per parenthesis depth
+
+    std::vector<std::string> eq, range, group, order, refs;
+    bool group_plain = true, order_plain = true;
+    std::vector<std::string> term; // current top-level GROUP/ORDER BY term
+    std::map<std::string, std::string> alias; // plain columns renamed by AS
+
+    for (size_t i = 0; i <= tokens.size(); ++i)
+    {
+        std::string tok = (i < tokens.size()) ? tokens[i] : "";
+        std::string lo = str_tolower(tok);
+
+        int next_clause = -1;
+        if (lo == "select")
+            next_clause = C_SELECT;
+        else if (lo == "from" || lo == "having" ||
+            lo == "limit" || lo == "window" || lo == "union" ||
+            lo == "except" || lo == "intersect" || lo == "values")
+            next_clause = C_NONE;
+        else if (lo == "where" || lo == "on")
+            next_clause = C_WHERE;
+        else if (lo == "group" && i + 1 < tokens.size() &&
+                 str_tolower(tokens[i+1]) == "by")
+            next_clause = C_GROUP, ++i;
+        else if (lo == "order" && i + 1 < tokens.size() &&
+                 str_tolower(tokens[i+1]) == "by")
+            next_clause = C_ORDER, ++i;
+
+        // finish top-level GROUP BY or ORDER BY term
+        if (clause.size() == 1 && (clause[0] == C_GROUP || clause[0] == C_ORDER) &&
+            (tok == "," || next_clause >= 0 || i == tokens.size()))
+        {
+            if (term.size() >= 2 &&
+                (str_tolower(term.back()) == "asc" || str_tolower(term.back()) == "desc"))
+                term.pop_back();
+
+            std::string col;
+            if (term.size() == 1) {
+                col = sql_match_column(term[0], columns);
+                if (alias.count(str_tolower(term[0])))
+                    col = alias[str_tolower(term[0])];
+            }
+            else if (term.size() == 3 && term[1] == ".")
+                col = sql_match_column(term[2], columns);
+
+            bool& plain = (clause[0] == C_GROUP) ? group_plain : order_plain;
+            if (col.empty())
+                plain = false;
+            else if (plain)
+                add_unique(clause[0] == C_GROUP ? group : order, col);
+
+            term.clear();
+            if (tok == ",") continue;
+        }
+
+        if (i == tokens.size()) break;
+
+        if (next_clause >= 0) {
+            clause.back() = next_clause;
+            continue;
+        }
+
+        if (tok == "(") {
+            clause.push_back(clause.back());
+        }
+        else if (tok == ")") {
+            if (clause.size() > 1) clause.pop_back();
+        }
+
+        if (clause[0] == C_GROUP || clause[0] == C_ORDER)
+            term.push_back(tok);
+
+        std::string col = sql_match_column(tok, columns);
+        if (col.empty()) continue;
+
+        // skip table qualifier of a column reference
+        if (i + 1 < tokens.size() && tokens[i+1] == ".") continue;
+
+        add_unique(refs, col);
+
+        // remember "col AS name" in the top-level select list
+        if (clause.size() == 1 && clause[0] == C_SELECT && i >= 1 &&
+            i + 2 < tokens.size() && str_tolower(tokens[i+1]) == "as" &&
+            (tokens[i-1] == "," || str_tolower(tokens[i-1]) == "select" ||
+             str_tolower(tokens[i-1]) == "distinct" || tokens[i-1] == "."))
+        {
+            alias[str_tolower(tokens[i+2])] = col;
+        }
+
+        if (clause.back() != C_WHERE) continue;
+
+        std::string next = (i + 1 < tokens.size()) ? str_tolower(tokens[i+1]) : "";
+        std::string prev = (i >= 1) ? tokens[i-1] : "";
+
+        if (next == "=" || next == "==" || next == "in" || next == "is")
+            add_unique(eq, col);
+        else if (next == "<" || next == ">" || next == "<=" || next == ">=" ||
+                 next == "between")
+            add_unique(range, col);
+        else if ((prev == "=" || prev == "==") &&
+                 (i < 2 || sql_match_column(tokens[i-2], columns).empty()))
+            add_unique(eq, col);
+    }
+
+    // equality columns first, then grouping and ordering, then one range.
+    std::vector<std::string> index = eq;
+    for (size_t i = 0; i < group.size(); ++i) add_unique(index, group[i]);
+    for (size_t i = 0; i < order.size(); ++i) add_unique(index, order[i]);
+    if (range.size()) add_unique(index, range[0]);
+
+    if (index.empty()) return index;
+
+    // append all other referenced columns to make the index covering
+    std::vector<std::string> covering = index;
+    for (size_t i = 0; i < refs.size(); ++i) add_unique(covering, refs[i]);
+
+    return (covering.size() <= 16) ? covering : index;
+}
+
+//! return detail lines of EXPLAIN QUERY PLAN for a query
+static inline std::vector<std::string>
+sqlite_query_plan(SQLiteDatabase& db, const std::string& query)
+{
+    std::vector<std::string> plan;
+
+    SqlQuery sql = db.query("EXPLAIN QUERY PLAN " + query);
+    while (sql->step())
+        plan.push_back(sql->text(sql->num_cols() - 1));
+
+    return plan;
+}
+
+//! create indexes which help the given read-only queries
+void SQLiteDatabase::advise_indexes(const std::vector<std::string>& queries)
+{
+    // matches SCAN and SEARCH lines, with optional TABLE of old SQLite
+    static const boost::regex
+        re_scan("(SCAN|SEARCH) (?:TABLE )?(\\S+)(?: AS \\S+)?(.*)");
+    boost::smatch rm;
+
+    std::vector<std::string> done;
+    std::set<std::string> analyze_tables;
+
+    for (size_t qi = 0; qi < queries.size(); ++qi)
+    {
+        const std::string& query = queries[qi];
+        if (std::find(done.begin(), done.end(), query) != done.end())
+            continue;
+        done.push_back(query);
+
+        std::vector<std::string> plan;
+        try {
+            plan = sqlite_query_plan(*this, query);
+        }
+        catch (std::runtime_error&) {
+            // errors are reported when the directive runs the query
+            continue;
+        }
+
+        // collect tables, and which are scanned completely
+        std::vector<std::string> tables;
+        std::set<std::string> full_scan;
+        bool temp_btree = false;
+
+        for (size_t i = 0; i < plan.size(); ++i)
+        {
+            if (boost::regex_match(plan[i], rm, re_scan))
+            {
+                add_unique(tables, rm[2].str());
+                if (rm[1] == "SCAN" && rm[3].str().find("USING") == std::string::npos)
+                    full_scan.insert(rm[2].str());
+            }
+            else if (is_prefix(plan[i], "USE TEMP B-TREE"))
+            {
+                temp_btree = true;
+            }
+        }
+
+        for (size_t ti = 0; ti < tables.size(); ++ti)
+        {
+            const std::string& table = tables[ti];
+            if (!temp_btree && full_scan.find(table) == full_scan.end())
+                continue;
+
+            std::vector<std::string> cols = advise_index(query, table);
+            if (cols.empty()) continue;
+
+            std::string name = "sp_idx_" + table;
+            std::string collist;
+            for (size_t i = 0; i < cols.size(); ++i) {
+                name += "_" + cols[i];
+                if (i != 0) collist += ", ";
+                collist += quote_field(cols[i]);
+            }
+
+            if (m_advised_indexes.find(name) != m_advised_indexes.end())
+                continue;
+            m_advised_indexes.insert(name);
+
+            std::string create =
+                "CREATE INDEX IF NOT EXISTS " + quote_field(name) +
+                " ON " + quote_field(table) + " (" + collist + ")";
+
+            OUT("Index advisor: " << create);
+            execute(create);
+            analyze_tables.insert(table);
+        }
+    }
+
+    for (std::set<std::string>::const_iterator ti = analyze_tables.begin();
+         ti != analyze_tables.end(); ++ti)
+    {
+        analyze(*ti);
+    }
+
+    // report full scans and temporary sorts which remain
+    for (size_t qi = 0; qi < done.size(); ++qi)
+    {
+        std::vector<std::string> plan;
+        try {
+            plan = sqlite_query_plan(*this, done[qi]);
+        }
+        catch (std::runtime_error&) {
+            continue;
+        }
+
+        for (size_t i = 0; i < plan.size(); ++i)
+        {
+            bool full_scan =
+                boost::regex_match(plan[i], rm, re_scan) &&
+                rm[1] == "SCAN" && rm[3].str().find("USING") == std::string::npos &&
+                sqlite_is_base_table(*this, rm[2].str());
+
+            if (full_scan || is_prefix(plan[i], "USE TEMP B-TREE"))
+                OUT("Index advisor: " << plan[i] << " remains in " << shorten(done[qi]));
+        }
+    }
+}
+
 //! test if a table exists in the database
 bool SQLiteDatabase::exist_table(const std::string& table)
 {
@@ -299,6 +862,113 @@ bool SQLiteDatabase::exist_table(const std::string& table)
     return (sql.text(0) != "0");
 }
 
+//! test if a table, view or other named object exists, including temporary
+//! ones, ignoring case.
+bool SQLiteDatabase::exist_object(const std::string& name)
+{
+    std::vector<std::string> params;
+    params.push_back(name);
+
+    SQLiteQuery sql(*this,
+                    "SELECT COUNT(*) FROM "
+                    "(SELECT name FROM sqlite_master UNION ALL "
+                    "SELECT name FROM sqlite_temp_master) "
+                    "WHERE name = $1 COLLATE NOCASE",
+                    params);
+
+    assert(sql.num_cols() == 1);
+    if (!sql.step()) {
+        OUT_THROW("exist_object() failed.");
+    }
+
+    return (sql.text(0) != "0");
+}
+
+//! return size and modification time of the database file and its
+//! write-ahead log, in-memory databases start empty in each run.
+std::string SQLiteDatabase::data_version()
+{
+    const char* path = sqlite3_db_filename(m_db, "main");
+    if (!path || !*path) return "memory";
+
+    std::ostringstream os;
+    const std::string files[2] = { path, std::string(path) + "-wal" };
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        struct stat st;
+        if (stat(files[i].c_str(), &st) != 0) {
+            os << " -";
+            continue;
+        }
+        os << ' ' << st.st_size << ':'
+           << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec;
+    }
+
+    return path + os.str();
+}
+
+//! return lower-case names of the temporary tables and views
+std::set<std::string> SQLiteDatabase::temp_objects()
+{
+    SQLiteQuery sql(*this,
+                    "SELECT lower(name) FROM sqlite_temp_master "
+                    "WHERE type IN ('table','view')");
+
+    std::set<std::string> names;
+    while (sql.step())
+        names.insert(sql.text(0));
+
+    return names;
+}
+
+//! return lower-case names of virtual table modules, which include the
+//! table-valued functions, of virtual tables and of views reading any of them,
+//! also through other views.
+std::set<std::string> SQLiteDatabase::virtual_objects()
+{
+    std::set<std::string> names;
+    {
+        SQLiteQuery sql(*this, "SELECT lower(name) FROM pragma_module_list");
+        while (sql.step())
+            names.insert(sql.text(0));
+    }
+
+    std::vector<std::string> views, view_sql;
+    {
+        SQLiteQuery sql(*this,
+                        "SELECT lower(name), type, sql FROM sqlite_master "
+                        "UNION ALL "
+                        "SELECT lower(name), type, sql FROM sqlite_temp_master");
+        while (sql.step())
+        {
+            if (sql.text(1) == "view") {
+                views.push_back(sql.text(0));
+                view_sql.push_back(sql.text(2));
+            }
+            else if (sql.text(1) == "table" &&
+                     is_prefix(str_tolower(sql.text(2)), "create virtual"))
+            {
+                names.insert(sql.text(0));
+            }
+        }
+    }
+
+    for (bool added = true; added; )
+    {
+        added = false;
+        for (size_t i = 0; i < views.size(); ++i)
+        {
+            if (!names.count(views[i]) && mentions_any(view_sql[i], names)) {
+                names.insert(views[i]);
+                added = true;
+            }
+        }
+    }
+
+    return names;
+}
+
 //! return last error message string
 const char* SQLiteDatabase::errmsg() const
 {
@@ -26,6 +26,8 @@
 
 #include <sqlite3.h>
 
+#include <set>
+
 #include "sql.h"
 
 class SQLiteQuery : public SqlQueryImpl, protected SqlDataCache
@@ -99,6 +101,13 @@ protected:
     //! for access to database connection
     friend class SQLiteQuery;
 
+    //! indexes created by advise_indexes()
+    std::set<std::string> m_advised_indexes;
+
+    //! return index column list suggested for a query on table, or empty
+    std::vector<std::string> advise_index(const std::string& query,
+                                          const std::string& table);
+
 public:
     //! virtual destructor to free connection
     virtual ~SQLiteDatabase();
@@ -125,9 +134,29 @@ public:
     virtual SqlQuery query(const std::string& query,
                            const std::vector<std::string>& params);
 
+    //! update planner statistics of a table after importing data
+    virtual void analyze(const std::string& table);
+
+    //! create indexes which help the given read-only queries
+    virtual void advise_indexes(const std::vector<std::string>& queries);
+
     //! test if a table exists in the database
     virtual bool exist_table(const std::string& table);
 
+    //! test if a table, view or other named object exists, including
+    //! temporary ones, ignoring case.
+    virtual bool exist_object(const std::string& name);
+
+    //! return size and modification time of the database file
+    virtual std::string data_version();
+
+    //! return lower-case names of the temporary tables and views
+    virtual std::set<std::string> temp_objects();
+
+    //! return lower-case names of virtual table modules, virtual tables and
+    //! views reading them
+    virtual std::set<std::string> virtual_objects();
+
     //! return last error message string
     const char* errmsg() const;
 };
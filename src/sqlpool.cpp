@@ -0,0 +1,171 @@
+/******************************************************************************
+ * src/sqlpool.cpp
+ *
+ * Pool of additional read connections which run independent queries in
+ * parallel threads.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "sqlpool.h"
+#include "common.h"
+#include "profile.h"
+#include "plan.h"
+
+SqlPool::SqlPool()
+    : m_next(0), m_pending(0), m_started(0), m_connected(0), m_quit(false)
+{
+}
+
+//! terminate workers and close their connections
+SqlPool::~SqlPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv_work.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+        m_threads[i].join();
+}
+
+//! open size connections, returns false if none could be established
+bool SqlPool::initialize(const std::string& conninfo, unsigned int size)
+{
+    for (unsigned int i = 0; i < size; ++i)
+        m_threads.push_back(std::thread(&SqlPool::worker, this, conninfo));
+
+    // wait for all workers to try their connection
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_started < m_threads.size())
+        m_cv_done.wait(lock);
+
+    if (m_connected == 0) {
+        OUT("Connection pool disabled: could not open any read connection.");
+        return false;
+    }
+
+    OUT("Connection pool with " << m_connected << " read connections.");
+    return true;
+}
+
+//! thread function: connect and run queries until shutdown
+void SqlPool::worker(const std::string& conninfo)
+{
+    g_profile_worker = true;
+
+    SqlDatabase* db = sql_connect(conninfo);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    ++m_started;
+    if (db) ++m_connected;
+    m_cv_done.notify_all();
+
+    if (!db) return;
+
+    while (1)
+    {
+        while (!m_quit && m_next >= m_queries.size())
+            m_cv_work.wait(lock);
+
+        if (m_quit) break;
+
+        size_t i = m_next++;
+        lock.unlock();
+
+        SqlQuery result;
+        try {
+            SqlQuery sql = db->query(m_queries[i]);
+            result = SqlQuery(new SqlMaterializedQuery(*sql));
+        }
+        catch (std::exception&) {
+            // failed queries are executed again on the main connection,
+            // which reports the error or sees temporary tables.
+        }
+
+        lock.lock();
+
+        m_results[i] = result;
+        if (--m_pending == 0)
+            m_cv_done.notify_all();
+    }
+
+    lock.unlock();
+    delete db;
+}
+
+//! run a batch of independent read-only queries in parallel and return their
+//! complete results in the same order, NULL for failed ones.
+std::vector<SqlQuery> SqlPool::run(const std::vector<std::string>& queries)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_queries = queries;
+    m_results.assign(queries.size(), SqlQuery());
+    m_next = 0;
+    m_pending = queries.size();
+
+    m_cv_work.notify_all();
+
+    while (m_pending != 0)
+        m_cv_done.wait(lock);
+
+    std::vector<SqlQuery> results;
+    results.swap(m_results);
+    m_queries.clear();
+
+    return results;
+}
+
+//! run a batch in parallel and hand the results to the given connection,
+//! returns the queries which failed or read temporary tables and are left to
+//! the connection.
+std::vector<std::string>
+SqlPool::provide(SqlDatabase& db, const std::vector<std::string>& queries)
+{
+    // temporary tables of the connection may shadow tables which the pool
+    // connections would read instead, hence queries mentioning them are left
+    // to the connection.
+    std::set<std::string> temp = db.temp_objects();
+
+    std::vector<std::string> pooled, remaining;
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        if (mentions_any(queries[i], temp))
+            remaining.push_back(queries[i]);
+        else
+            pooled.push_back(queries[i]);
+    }
+
+    std::vector<SqlQuery> results = run(pooled);
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        if (results[i])
+            db.provide_result(pooled[i], results[i]);
+        else
+            remaining.push_back(pooled[i]);
+    }
+
+    if (gopt_verbose >= 1)
+        OUT("Pool ran " << queries.size() - remaining.size() << " of "
+            << queries.size() << " queries.");
+
+    return remaining;
+}
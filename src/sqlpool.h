@@ -0,0 +1,97 @@
+/******************************************************************************
+ * src/sqlpool.h
+ *
+ * Pool of additional read connections which run independent queries in
+ * parallel threads.
+ *
+ ******************************************************************************
+ * Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef SQLPOOL_HEADER
+#define SQLPOOL_HEADER
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sql.h"
+
+//! Pool of read connections to the same database. Each connection is opened
+//! and used only by its own worker thread, and results are copied into memory
+//! such that they can be consumed by the main thread in document order.
+class SqlPool
+{
+protected:
+    //! worker threads, one per connection
+    std::vector<std::thread> m_threads;
+
+    //! lock protecting all following fields
+    std::mutex m_mutex;
+
+    //! signaled when new queries are available or on shutdown
+    std::condition_variable m_cv_work;
+
+    //! signaled when workers start up or finish queries
+    std::condition_variable m_cv_done;
+
+    //! queries of current batch
+    std::vector<std::string> m_queries;
+
+    //! results of current batch, NULL for failed queries
+    std::vector<SqlQuery> m_results;
+
+    //! index of next query to pick up
+    size_t m_next;
+
+    //! number of queries not yet finished
+    size_t m_pending;
+
+    //! number of workers which tried to connect
+    size_t m_started;
+
+    //! number of workers with a connection
+    size_t m_connected;
+
+    //! set to terminate the workers
+    bool m_quit;
+
+    //! thread function: connect and run queries until shutdown
+    void worker(const std::string& conninfo);
+
+public:
+    SqlPool();
+
+    //! terminate workers and close their connections
+    ~SqlPool();
+
+    //! open size connections, returns false if none could be established
+    bool initialize(const std::string& conninfo, unsigned int size);
+
+    //! run a batch of independent read-only queries in parallel and return
+    //! their complete results in the same order, NULL for failed ones.
+    std::vector<SqlQuery> run(const std::vector<std::string>& queries);
+
+    //! run a batch in parallel and hand the results to the given connection,
+    //! returns the queries which failed or read temporary tables and are left
+    //! to the connection.
+    std::vector<std::string>
+    provide(SqlDatabase& db, const std::vector<std::string>& queries);
+};
+
+#endif // SQLPOOL_HEADER
@@ -23,6 +23,7 @@
 #ifndef STRTOOLS_HEADER
 #define STRTOOLS_HEADER
 
+#include <cctype>
 #include <string>
 #include <iostream>
 #include <iomanip>
@@ -147,6 +148,16 @@ static inline bool is_suffix(const std::string& str, const std::string& match)
 		       str.end() - match.size() );
 }
 
+/**
+ * Returns the index of the first non-blank character at or after pos.
+ */
+static inline std::string::size_type
+skip_blanks(const std::string& str, std::string::size_type pos = 0)
+{
+    while (pos < str.size() && isblank((unsigned char)str[pos])) ++pos;
+    return pos;
+}
+
 /**
  * Shorten a string to width charaters, adding "..." at the end. Due to latex
  * parsing problems, balance parenthesis and brackets while shortening.
@@ -24,9 +24,18 @@
 #define TEXTLINES_HEADER
 
 #include "strtools.h"
+#include "profile.h"
 #include <cassert>
+#include <iterator>
 
 //! Class to work with text files line by line.
+//!
+//! Directives replace lines at or after the line currently processed, hence
+//! edits are applied at a moving cursor: the lines before it are kept in an
+//! edited head array, the lines after it remain untouched in the original
+//! array. Moving the cursor forward moves each line into the head once, such
+//! that all edits of a document take time linear in its size and line numbers
+//! of the tail are adjusted lazily by the cursor offset.
 class TextLines
 {
 protected:
@@ -34,45 +43,96 @@ protected:
     //! line container type
     typedef std::vector<std::string> slist_type;
 
-    //! array of lines in text file
+    //! edited lines before the cursor
+    slist_type m_head;
+
+    //! original lines, those from index m_tail on are after the cursor
     slist_type m_lines;
 
+    //! index of first original line after the cursor
+    size_t m_tail;
+
+    //! move the cursor forward to line pos
+    void advance(size_t pos)
+    {
+        assert(pos <= size());
+        while (m_head.size() < pos)
+            m_head.push_back(std::move(m_lines[m_tail++]));
+    }
+
+    //! replace lines [begin,end) with content, moving the strings out of it
+    void splice(size_t begin, size_t end, slist_type& content)
+    {
+        if (begin >= m_head.size())
+        {
+            // common case: edit after the cursor
+            advance(begin);
+            m_tail += end - begin;
+            for (size_t i = 0; i < content.size(); ++i)
+                m_head.push_back(std::move(content[i]));
+        }
+        else
+        {
+            // edit before the cursor, splice the head array
+            advance(end);
+            m_head.erase(m_head.begin() + begin, m_head.begin() + end);
+            m_head.insert(m_head.begin() + begin,
+                          std::make_move_iterator(content.begin()),
+                          std::make_move_iterator(content.end()));
+        }
+    }
+
+    //! log and profile replacement of lines [begin,end) with content
+    void replace_log(size_t begin, size_t end, const slist_type& content,
+                     const std::string& desc)
+    {
+        if (begin == end)
+            OUT("Inserting " << desc << " at line " << begin);
+        else
+            OUT("Replace lines [" << begin << "," << end << ") with " << desc);
+
+        if (Profile::Record* r = profile_record())
+        {
+            for (size_t i = 0; i < content.size(); ++i)
+                r->bytes += content[i].size() + 1;
+        }
+    }
+
 public:
 
+    TextLines()
+        : m_tail(0)
+    { }
+
     //! return number of lines
     size_t size() const
     {
-        return m_lines.size();
+        return m_head.size() + m_lines.size() - m_tail;
     }
 
     //! return const reference to a line
     const std::string& line(size_t i) const
     {
-        assert(i < m_lines.size());
-        return m_lines[i];
+        assert(i < size());
+        return i < m_head.size() ? m_head[i]
+               : m_lines[m_tail + i - m_head.size()];
     }
 
     //! return const reference to a line
     const std::string& operator[] (size_t i) const
     {
-        assert(i < m_lines.size());
-        return m_lines[i];
+        return line(i);
     }
 
     //! replace lines [begin,end) with content (or type desc)
     void replace(size_t begin, size_t end, const std::vector<std::string>& content,
                  const std::string& desc)
     {
-        if (begin == end)
-            OUT("Inserting " << desc << " at line " << begin);
-        else
-            OUT("Replace lines [" << begin << "," << end << ") with " << desc);
-
-        m_lines.erase(m_lines.begin() + begin,
-                      m_lines.begin() + end);
+        replace_log(begin, end, content, desc);
+        ProfileTimer timer(Profile::REWRITE);
 
-        m_lines.insert(m_lines.begin() + begin,
-                       content.begin(), content.end());
+        slist_type ccopy(content);
+        splice(begin, end, ccopy);
     }
 
     //! replace lines [begin,end) with indented content (or type desc)
@@ -80,15 +140,17 @@ public:
                  const std::vector<std::string>& content,
                  const std::string& desc)
     {
-        if (indent == 0) return replace(begin, end, content, desc);
-
-        std::vector<std::string> ccopy(content.size());
+        slist_type clist(content.size());
         for (size_t si = 0; si < content.size(); ++si)
         {
-            ccopy[si] = std::string(indent, ' ') + content[si];
+            clist[si].reserve(indent + content[si].size());
+            clist[si].append(indent, ' ').append(content[si]);
         }
 
-        return replace(begin, end, ccopy, desc);
+        replace_log(begin, end, clist, desc);
+        ProfileTimer timer(Profile::REWRITE);
+
+        splice(begin, end, clist);
     }
 
     //! replace lines [begin,end) with indented content (or type desc)
@@ -97,20 +159,31 @@ public:
     {
         slist_type clist;
 
-        std::string line;
-        std::istringstream is(content);
-        while ( std::getline(is,line) )
+        // split into lines like std::getline, without a final empty line
+        for (size_t pos = 0; pos < content.size(); )
         {
-            clist.push_back(std::string(indent, ' ') + line);
+            size_t nl = content.find('\n', pos);
+            if (nl == std::string::npos) nl = content.size();
+
+            clist.push_back(std::string());
+            clist.back().reserve(indent + nl - pos);
+            clist.back().append(indent, ' ').append(content, pos, nl - pos);
+
+            pos = nl + 1;
         }
 
-        return replace(begin, end, clist, desc);
+        replace_log(begin, end, clist, desc);
+        ProfileTimer timer(Profile::REWRITE);
+
+        splice(begin, end, clist);
     }
 
     //! read complete file line-wise
     void read_stream(std::istream& is)
     {
+        m_head.clear();
         m_lines.clear();
+        m_tail = 0;
 
         std::string line;
         while ( std::getline(is,line) )
@@ -123,10 +196,9 @@ public:
     void write_stream(std::ostream& os) const
     {
         // output line
-        for (slist_type::const_iterator i = m_lines.begin();
-             i != m_lines.end(); ++i)
+        for (size_t i = 0; i < size(); ++i)
         {
-            os << *i << std::endl;
+            os << line(i) << '\n';
         }
     }
 
@@ -195,10 +267,10 @@ public:
             cmd = cmd.substr(2);
 
             // collect lines while they are at the same indentation level
-            while ( ln < m_lines.size() &&
+            while ( ln < size() &&
                     is_comment_line<CommentChar>(ln) == indent )
             {
-                cmd += m_lines[ln++].substr(indent+1);
+                cmd += line(ln++).substr(indent+1);
             }
         }
         // multi-line command prefixed with two comment chars
@@ -208,10 +280,10 @@ public:
             cmd = cmd.substr(1);
 
             // collect lines while they are at the same indentation level
-            while ( ln < m_lines.size() &&
+            while ( ln < size() &&
                     is_comment_line<CommentChar>(ln, 2) == indent )
             {
-                cmd += m_lines[ln++].substr(indent+2);
+                cmd += line(ln++).substr(indent+2);
             }
         }
 
@@ -0,0 +1,12 @@
+set terminal pdf size 28cm,18cm linewidth 2.0
+set output "test.pdf"
+# IMPORT-DATA test test.data
+set key top right
+
+## PLOT(maxpoints=8) SELECT testsize AS x, FLOOR(bandwidth) AS y FROM test
+## WHERE funcname='ScanWrite64PtrUnrollLoop' ORDER BY x
+
+## MULTIPLOT(funcname|maxpoints=6) SELECT testsize AS x, FLOOR(bandwidth) AS y, MULTIPLOT
+## FROM test WHERE host='earth' ORDER BY MULTIPLOT,x
+
+quit
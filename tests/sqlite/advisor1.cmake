@@ -0,0 +1,45 @@
+###############################################################################
+# tests/sqlite/advisor1.cmake
+#
+# Runs sqlplot-tools -I on advisor1.tex, checks its output against advisor1.out
+# and the index advisor's log lines against the expected advice.
+#
+# Usage: cmake -DSQLPLOT=<program> -DSRC=<source dir> -P advisor1.cmake
+#
+###############################################################################
+# Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+#
+# This program is free software: you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program.  If not, see <http://www.gnu.org/licenses/>.
+###############################################################################
+
+set(expected
+  "Index advisor: CREATE INDEX IF NOT EXISTS \"sp_idx_adv_größe_algo\" ON \"adv\" (\"größe\", \"algo\")"
+  "Index advisor: CREATE INDEX IF NOT EXISTS \"sp_idx_adv_algo_time_id\" ON \"adv\" (\"algo\", \"time\", \"id\")"
+  "Index advisor: SCAN adv remains in SELECT SUM(mem) AS m FROM adv WHERE mem % 7 = 0"
+  )
+
+execute_process(COMMAND ${SQLPLOT} -D Sqlite -I -C advisor1.tex -o advisor1.out
+  WORKING_DIRECTORY ${SRC} RESULT_VARIABLE rc ERROR_VARIABLE log)
+if(NOT rc EQUAL 0)
+  message(FATAL_ERROR "run with -I failed:\n${log}")
+endif()
+
+# collect advisor lines of the log
+string(REGEX MATCHALL "Index advisor: [^\n]*" advice "${log}")
+
+if(NOT advice STREQUAL expected)
+  string(REPLACE ";" "\n" advice "${advice}")
+  string(REPLACE ";" "\n" expected "${expected}")
+  message(FATAL_ERROR "unexpected advice:\n${advice}\nexpected:\n${expected}")
+endif()
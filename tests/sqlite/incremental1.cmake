@@ -0,0 +1,96 @@
+###############################################################################
+# tests/sqlite/incremental1.cmake
+#
+# Runs sqlplot-tools -i repeatedly on a copy of incremental1.tex while editing
+# commands, output blocks and data files. After each run the file must equal
+# the result of processing the same input completely, and the expected number
+# of directives must have been skipped.
+#
+# Usage: cmake -DSQLPLOT=<program> -DSRC=<source dir> -DWORK=<work dir>
+#              -P incremental1.cmake
+#
+###############################################################################
+# Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+#
+# This program is free software: you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program.  If not, see <http://www.gnu.org/licenses/>.
+###############################################################################
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+file(COPY ${SRC}/incremental1.tex ${SRC}/incremental1.data
+  ${SRC}/incremental1b.data DESTINATION ${WORK})
+
+# run -i on incremental1.tex, compare with a complete run on a copy of the same
+# input and check the number of skipped directives
+function(check step skips)
+  file(READ ${WORK}/incremental1.tex input)
+  file(WRITE ${WORK}/reference.tex "${input}")
+
+  execute_process(COMMAND ${SQLPLOT} -D Sqlite reference.tex
+    WORKING_DIRECTORY ${WORK} RESULT_VARIABLE rc ERROR_VARIABLE log)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${step}: complete run failed:\n${log}")
+  endif()
+
+  execute_process(COMMAND ${SQLPLOT} -D Sqlite -i incremental1.tex
+    WORKING_DIRECTORY ${WORK} RESULT_VARIABLE rc ERROR_VARIABLE log)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${step}: incremental run failed:\n${log}")
+  endif()
+
+  file(READ ${WORK}/reference.tex expected)
+  file(READ ${WORK}/incremental1.tex output)
+  if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "${step}: output differs from complete run:\n"
+      "${output}\nexpected:\n${expected}")
+  endif()
+
+  string(REGEX MATCHALL "Unchanged since last run, skipped" found "${log}")
+  list(LENGTH found count)
+  if(NOT count EQUAL skips)
+    message(FATAL_ERROR "${step}: skipped ${count} directives, "
+      "expected ${skips}:\n${log}")
+  endif()
+endfunction()
+
+# replace text in a file of the work directory
+function(edit file from to)
+  file(READ ${WORK}/${file} data)
+  string(FIND "${data}" "${from}" pos)
+  if(pos EQUAL -1)
+    message(FATAL_ERROR "edit: '${from}' not found in ${file}")
+  endif()
+  string(REPLACE "${from}" "${to}" data "${data}")
+  file(WRITE ${WORK}/${file} "${data}")
+endfunction()
+
+# first run creates the state, second run skips all tracked directives
+check("first run" 0)
+check("second run" 2)
+
+# changed command
+edit(incremental1.tex "WHERE v < 10" "WHERE v < 3")
+check("edited command" 1)
+
+# changed output block
+edit(incremental1.tex "| 4 | 20 |" "| 4 | 21 |")
+check("edited output" 1)
+
+# file read only by the virtual table, which is never skipped
+file(APPEND ${WORK}/incremental1b.data "RESULT v=200\n")
+check("edited virtual table file" 2)
+
+# file imported by IMPORT-DATA
+file(APPEND ${WORK}/incremental1.data "RESULT v=7\n")
+check("edited imported file" 0)
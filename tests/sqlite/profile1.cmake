@@ -0,0 +1,64 @@
+###############################################################################
+# tests/sqlite/profile1.cmake
+#
+# Runs sqlplot-tools --profile on a copy of profile1.tex whose name contains a
+# space, then imports the RESULT lines of the report with IMPORT-DATA and
+# checks the parsed file names, lines, directives and row counts.
+#
+# Usage: cmake -DSQLPLOT=<program> -DSRC=<source dir> -DWORK=<work dir>
+#              -P profile1.cmake
+#
+###############################################################################
+# Copyright (C) 2013-2016 Timo Bingmann <tb@panthema.net>
+#
+# This program is free software: you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program.  If not, see <http://www.gnu.org/licenses/>.
+###############################################################################
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+configure_file(${SRC}/profile1.tex "${WORK}/profile 1.tex" COPYONLY)
+
+execute_process(COMMAND ${SQLPLOT} -D Sqlite --profile=report.txt "profile 1.tex"
+  WORKING_DIRECTORY ${WORK} RESULT_VARIABLE rc ERROR_VARIABLE log)
+if(NOT rc EQUAL 0)
+  message(FATAL_ERROR "profiled run failed:\n${log}")
+endif()
+
+file(WRITE ${WORK}/check.tex
+  "% IMPORT-DATA prof report.txt\n\n"
+  "% TEXTTABLE SELECT file, line, kind, rows, total >= 0 AS timed FROM prof\n")
+
+execute_process(COMMAND ${SQLPLOT} -D Sqlite check.tex
+  WORKING_DIRECTORY ${WORK} RESULT_VARIABLE rc ERROR_VARIABLE log)
+if(NOT rc EQUAL 0)
+  message(FATAL_ERROR "importing the report failed:\n${log}")
+endif()
+
+set(expected [=[% IMPORT-DATA prof report.txt
+
+% TEXTTABLE SELECT file, line, kind, rows, total >= 0 AS timed FROM prof
++---------------+------+-----------+------+-------+
+|          file | line |      kind | rows | timed |
++---------------+------+-----------+------+-------+
+| profile 1.tex |    4 | SQL       |    0 |     1 |
+| profile 1.tex |    6 | TEXTTABLE |    2 |     1 |
+| profile 1.tex |   15 | TEXTTABLE |    1 |     1 |
++---------------+------+-----------+------+-------+
+% END TEXTTABLE SELECT file, line, kind, rows, total >= 0 AS timed FROM prof
+]=])
+
+file(READ ${WORK}/check.tex output)
+if(NOT output STREQUAL expected)
+  message(FATAL_ERROR "imported report differs:\n${output}\nexpected:\n${expected}")
+endif()